@@ -55,6 +55,10 @@ public:
         other.data = nullptr;
     }
 
+    ~ArraySequence() override {
+        delete data;
+    }
+
     ArraySequence<T>& operator=(const ArraySequence<T>& other)
     {
         if (this == &other)
@@ -139,9 +143,18 @@ public:
         return this;
     }
 
+    void RemoveLast() {
+        if (GetLength() == 0)
+            throw std::out_of_range("IndexOutOfRange");
+        data->Resize(GetLength() - 1);
+    }
+
+    // keeps the capacity, so a sequence refilled every frame or query
+    // stops allocating once it has grown
     void Clear() {
-        delete data;
-        data = new DynamicArray<T>(0);
+        if (!data)
+            data = new DynamicArray<T>(0);
+        data->Clear();
     }
 
     void Reserve(int capacity) {
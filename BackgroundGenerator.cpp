@@ -0,0 +1,99 @@
+#include "BackgroundGenerator.h"
+#include <utility>
+
+BackgroundGenerator::BackgroundGenerator(uint64_t seed)
+    : seed(seed), worker(&BackgroundGenerator::work, this)
+{
+}
+
+BackgroundGenerator::~BackgroundGenerator()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void BackgroundGenerator::request(const ArraySequence<GenJob>& jobs)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.Clear();
+        for (const GenJob& job : jobs){
+            bool known = findDone(job.q, job.r, job.rec) >= 0 ||
+                         (busy && running.q == job.q && running.r == job.r &&
+                          HexGenerator::sameInputs(running.rec, job.rec));
+            if (!known)
+                queue.Append(job);
+        }
+    }
+    wake.notify_one();
+}
+
+bool BackgroundGenerator::take(int q, int r, const GenRecord& rec, GenResult& out)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&] {
+        return !busy || running.q != q || running.r != r ||
+               !HexGenerator::sameInputs(running.rec, rec);
+    });
+
+    int i = findDone(q, r, rec);
+    if (i < 0)
+        return false;
+    out = std::move(done[i]);
+    if (i != done.GetLength() - 1)
+        done[i] = std::move(done[done.GetLength() - 1]);
+    done.RemoveLast();
+    return true;
+}
+
+void BackgroundGenerator::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    queue.Clear();
+    done.Clear();
+}
+
+int BackgroundGenerator::findDone(int q, int r, const GenRecord& rec) const
+{
+    for (int i = 0; i < done.GetLength(); ++i){
+        const GenResult& res = done[i];
+        if (res.q == q && res.r == r && HexGenerator::sameInputs(res.rec, rec))
+            return i;
+    }
+    return -1;
+}
+
+void BackgroundGenerator::work()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true){
+        wake.wait(guard, [&] { return stop || queue.GetLength() > 0; });
+        if (stop)
+            return;
+
+        running = queue[0];
+        for (int i = 1; i < queue.GetLength(); ++i)
+            queue[i - 1] = queue[i];
+        queue.RemoveLast();
+        busy = true;
+
+        guard.unlock();
+        GenResult res;
+        HexGenerator::generateDetached(running.q, running.r, running.rec, seed, res);
+        guard.lock();
+
+        // oldest guesses go first
+        if (done.GetLength() == MAX_DONE){
+            for (int i = 1; i < done.GetLength(); ++i)
+                done[i - 1] = std::move(done[i]);
+            done.RemoveLast();
+        }
+        done.Append(std::move(res));
+        busy = false;
+        finished.notify_all();
+    }
+}
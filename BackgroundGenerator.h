@@ -0,0 +1,52 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "HexGenerator.h"
+
+struct GenJob
+{
+    int q = 0;
+    int r = 0;
+    GenRecord rec;
+};
+
+// Generates the hexes the cursor is likely to enter next on a worker
+// thread. Jobs run in a private grid (HexGenerator::generateDetached), the
+// live HexGrid is only changed on the caller's thread by take + commit.
+class BackgroundGenerator
+{
+public:
+    explicit BackgroundGenerator(uint64_t seed);
+    ~BackgroundGenerator();
+    BackgroundGenerator(const BackgroundGenerator&) = delete;
+    BackgroundGenerator& operator=(const BackgroundGenerator&) = delete;
+
+    // Replaces the queued guesses. A job already running is finished.
+    void request(const ArraySequence<GenJob>& jobs);
+
+    // Hands out the result for (q, r) if it was built from exactly these
+    // inputs. Waits when that job is the one running right now.
+    bool take(int q, int r, const GenRecord& rec, GenResult& out);
+
+    // Drops queued jobs and finished results, e.g. after a teleport.
+    void clear();
+
+private:
+    void work();
+    int findDone(int q, int r, const GenRecord& rec) const;
+
+    uint64_t seed;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    ArraySequence<GenJob> queue;
+    ArraySequence<GenResult> done;
+    GenJob running;
+    bool busy = false;
+    bool stop = false;
+    std::thread worker;
+
+    static const int MAX_DONE = 8;
+};
@@ -0,0 +1,175 @@
+#include "CellStore.h"
+#include <cmath>
+
+using HexGeometry::dirStep;
+
+uint64_t CellStore::Key(int q, int r)
+{
+    return (uint64_t(uint32_t(q)) << 32) | uint32_t(r);
+}
+
+CellPos CellStore::Origin(int q, int r)
+{
+    const int cx = int(std::floor(HexGeometry::centerX(q, r, HexGeometry::LatticeRadius)));
+    const int cy = 3 * HexGeometry::LatticeRadius * r / 2;
+    return { cx - HalfWidth, cy - HexGeometry::LatticeRadius };
+}
+
+const CellStore::Block* CellStore::FindBlock(int q, int r) const
+{
+    const int slot = blockIndex.Find(Key(q, r));
+    return slot < 0 ? nullptr : &blocks[slot];
+}
+
+CellStore::Block& CellStore::BlockFor(int q, int r)
+{
+    int slot = blockIndex.Find(Key(q, r));
+    if (slot >= 0)
+        return blocks[slot];
+
+    if (freeBlocks.GetLength() > 0) {
+        slot = freeBlocks.GetLast();
+        freeBlocks.RemoveLast();
+    } else {
+        slot = blocks.GetLength();
+        blocks.Append(Block());
+    }
+    blockIndex.Insert(Key(q, r), slot);
+
+    Block& b = blocks[slot];
+    b.q = q;
+    b.r = r;
+    b.slot = slot;
+    b.origin = Origin(q, r);
+    b.count = 0;
+    for (int i = 0; i < BlockCells; ++i) {
+        int oq, orr;
+        HexGeometry::nearestHex(b.origin.x + i % BlockWidth, b.origin.y + i / BlockWidth, oq, orr);
+        b.cells[i] = (oq == q && orr == r) ? Owned : 0;
+    }
+    return b;
+}
+
+int CellStore::Find(const CellPos& p) const
+{
+    int q, r;
+    HexGeometry::nearestHex(p.x, p.y, q, r);
+    const Block* b = FindBlock(q, r);
+    if (!b)
+        return -1;
+    int i = (p.y - b->origin.y) * BlockWidth + (p.x - b->origin.x);
+    return (b->cells[i] & Present) ? b->slot * BlockCells + i : -1;
+}
+
+int CellStore::Add(const CellPos& p, bool& created)
+{
+    created = false;
+    int q, r;
+    HexGeometry::nearestHex(p.x, p.y, q, r);
+    Block& b = BlockFor(q, r);
+
+    int i = (p.y - b.origin.y) * BlockWidth + (p.x - b.origin.x);
+    int id = b.slot * BlockCells + i;
+    uint8_t& cell = b.cells[i];
+    if (cell & Present)
+        return id;
+
+    created = true;
+    cell |= Present;
+    ++b.count;
+    ++count;
+
+    // corridors left pointing at this position by a removed cell
+    for (int d = 0; d < 4; ++d) {
+        int nb = Find(p + dirStep[d]);
+        if (nb >= 0 && HasEdge(nb, d ^ 1))
+            cell |= uint8_t(1 << d);
+    }
+    return id;
+}
+
+void CellStore::Remove(int id)
+{
+    Block& b = blocks[id / BlockCells];
+    uint8_t& cell = b.cells[id % BlockCells];
+    if (!(cell & Present))
+        return;
+    cell &= Owned;
+    --count;
+    if (--b.count > 0)
+        return;
+
+    blockIndex.Erase(Key(b.q, b.r));
+    freeBlocks.Append(b.slot);
+}
+
+bool CellStore::Contains(int id) const
+{
+    return id >= 0 && id < IdLimit() && (Byte(id) & Present);
+}
+
+CellPos CellStore::Pos(int id) const
+{
+    const Block& b = blocks[id / BlockCells];
+    int i = id % BlockCells;
+    return { b.origin.x + i % BlockWidth, b.origin.y + i / BlockWidth };
+}
+
+void CellStore::HexOf(int id, int& q, int& r) const
+{
+    const Block& b = blocks[id / BlockCells];
+    q = b.q;
+    r = b.r;
+}
+
+int CellStore::Neighbor(int id, int d) const
+{
+    if (!HasEdge(id, d))
+        return -1;
+    const int i = id % BlockCells;
+    const int x = i % BlockWidth + dirStep[d].x;
+    const int y = i / BlockWidth + dirStep[d].y;
+    if (x >= 0 && x < BlockWidth && y >= 0 && y < BlockHeight) {
+        int to = id - i + y * BlockWidth + x;
+        if (Byte(to) & Owned)
+            return (Byte(to) & Present) ? to : -1;
+    }
+    return Find(Pos(id) + dirStep[d]);
+}
+
+void CellStore::Link(int from, int d, int to)
+{
+    Byte(from) |= uint8_t(1 << d);
+    Byte(to) |= uint8_t(1 << (d ^ 1));
+}
+
+int CellStore::FirstInHex(int q, int r) const
+{
+    // same order as ForEachInHex, stopping at the first hit; an emptied
+    // block is skipped on its count alone
+    const Block* b = FindBlock(q, r);
+    if (b && b->count > 0) {
+        for (int i = 0; i < BlockCells; ++i)
+            if (b->cells[i] & Present)
+                return b->slot * BlockCells + i;
+    }
+    if (std::abs(2 * q + r) > 1)
+        return -1;
+    const int cy = 3 * HexGeometry::LatticeRadius * r / 2;
+    for (int y = cy - HexGeometry::LatticeRadius; y <= cy + HexGeometry::LatticeRadius; ++y) {
+        const CellPos p = { 0, y };
+        int oq, orr;
+        HexGeometry::nearestHex(p.x, p.y, oq, orr);
+        if ((oq != q || orr != r) && HexGeometry::insideHex(q, r, p)) {
+            int id = Find(p);
+            if (id >= 0)
+                return id;
+        }
+    }
+    return -1;
+}
+
+size_t CellStore::MemoryBytes() const
+{
+    return size_t(blocks.GetLength()) * sizeof(Block) + blockIndex.MemoryBytes();
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include "ArraySequence.h"
+#include "ChunkedArray.h"
+#include "FlatIndex.h"
+#include "HexGeometry.h"
+
+// Maze cells as one byte each: a 4-bit corridor mask plus a presence bit,
+// kept in one dense block per hex. A block covers the bounding box of its
+// hex; a lattice point is stored in the block of the hex nearestHex picks
+// for it, so a cell on a shared border lives in exactly one block. A cell
+// id is the block slot times BlockCells plus the offset in the box, so
+// position and neighbours are computed from the id; no per-cell record or
+// hash entry exists.
+//
+// Bit d of the mask is a corridor towards pos + dirStep[d]. It stays set
+// when the cell on the other end is removed, and a cell added there again
+// picks the link back up.
+class CellStore {
+public:
+    // x spans floor(cx) - HalfWidth .. floor(cx) + HalfWidth + 1,
+    // y spans cy - LatticeRadius .. cy + LatticeRadius
+    static constexpr int HalfWidth = int(HexGeometry::LatticeRadius * HexGeometry::Sqrt3 / 2);
+    static constexpr int BlockWidth = 2 * HalfWidth + 2;
+    static constexpr int BlockHeight = 2 * HexGeometry::LatticeRadius + 1;
+    static constexpr int BlockCells = BlockWidth * BlockHeight;
+    static constexpr uint8_t EdgeMask = 0x0F;
+    static constexpr uint8_t Present = 0x10;
+    // the point belongs to this block's hex
+    static constexpr uint8_t Owned = 0x20;
+
+    // -1 when no cell is stored at p
+    int Find(const CellPos& p) const;
+    // created is false when the cell already existed
+    int Add(const CellPos& p, bool& created);
+    void Remove(int id);
+
+    bool Contains(int id) const;
+    CellPos Pos(int id) const;
+    // hex whose block holds the id
+    void HexOf(int id, int& q, int& r) const;
+    uint8_t Edges(int id) const { return Byte(id) & EdgeMask; }
+    bool HasEdge(int id, int d) const { return Byte(id) & (1 << d); }
+
+    // The cell a corridor leads to, or -1 when there is no corridor or the
+    // cell on its far end is not stored.
+    int Neighbor(int id, int d) const;
+
+    // Opens the corridor between from and its neighbour to in direction d.
+    void Link(int from, int d, int to);
+
+    // Calls visit(id) for every stored cell inside or on the border of hex
+    // (q, r): its own block in row order, then the border cells kept in a
+    // neighbour's block. Border lattice points all lie on x == 0 (the side
+    // tests only tie at 2x == 0), so only hexes straddling that column have
+    // any.
+    template <class F>
+    void ForEachInHex(int q, int r, F&& visit) const
+    {
+        if (const Block* b = FindBlock(q, r)) {
+            const int base = b->slot * BlockCells;
+            for (int i = 0; i < BlockCells; ++i)
+                if (b->cells[i] & Present)
+                    visit(base + i);
+        }
+        if (std::abs(2 * q + r) > 1)
+            return;
+        const int cy = 3 * HexGeometry::LatticeRadius * r / 2;
+        for (int y = cy - HexGeometry::LatticeRadius; y <= cy + HexGeometry::LatticeRadius; ++y) {
+            const CellPos p = { 0, y };
+            int oq, orr;
+            HexGeometry::nearestHex(p.x, p.y, oq, orr);
+            if ((oq != q || orr != r) && HexGeometry::insideHex(q, r, p)) {
+                int id = Find(p);
+                if (id >= 0)
+                    visit(id);
+            }
+        }
+    }
+
+    // first cell ForEachInHex would visit, or -1
+    int FirstInHex(int q, int r) const;
+
+    int GetCount() const { return count; }
+    // every id is below IdLimit
+    int IdLimit() const { return blocks.GetLength() * BlockCells; }
+    size_t MemoryBytes() const;
+
+private:
+    struct Block
+    {
+        int q = 0;
+        int r = 0;
+        int slot = 0;
+        CellPos origin;
+        int count = 0;
+        uint8_t cells[BlockCells] = {};
+    };
+
+    static uint64_t Key(int q, int r);
+    static CellPos Origin(int q, int r);
+    const Block* FindBlock(int q, int r) const;
+    Block& BlockFor(int q, int r);
+    uint8_t Byte(int id) const { return blocks[id / BlockCells].cells[id % BlockCells]; }
+    uint8_t& Byte(int id) { return blocks[id / BlockCells].cells[id % BlockCells]; }
+
+    ChunkedArray<Block, 4> blocks;
+    FlatIndex blockIndex;
+    ArraySequence<int> freeBlocks;
+    int count = 0;
+};
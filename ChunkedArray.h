@@ -0,0 +1,135 @@
+#pragma once
+#include <stdexcept>
+#include <iterator>
+#include <utility>
+#include "ArraySequence.h"
+
+// Append-only array stored in fixed-size chunks: elements never move once
+// appended, so pointers and indices into it stay valid while it grows.
+template <class T, int ChunkBits = 8>
+class ChunkedArray {
+public:
+    static constexpr int ChunkSize = 1 << ChunkBits;
+    static constexpr int ChunkMask = ChunkSize - 1;
+
+    template <class Owner, class Value>
+    class BasicIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = Value*;
+        using reference         = Value&;
+
+        BasicIterator(Owner* owner = nullptr, int index = 0) : owner(owner), index(index) {}
+
+        reference operator*() const { return (*owner)[index]; }
+        pointer operator->() const { return &(*owner)[index]; }
+
+        BasicIterator& operator++() { ++index; return *this; }
+        BasicIterator operator++(int) { BasicIterator tmp(*this); ++index; return tmp; }
+
+        bool operator==(const BasicIterator& other) const { return index == other.index; }
+        bool operator!=(const BasicIterator& other) const { return index != other.index; }
+
+        int GetIndex() const { return index; }
+
+    private:
+        Owner* owner;
+        int index;
+    };
+
+    using Iterator = BasicIterator<ChunkedArray, T>;
+    using ConstIterator = BasicIterator<const ChunkedArray, const T>;
+
+    ChunkedArray() = default;
+
+    ChunkedArray(const ChunkedArray<T, ChunkBits>& other)
+    {
+        for (int i = 0; i < other.GetLength(); ++i)
+            Append(other[i]);
+    }
+
+    ChunkedArray(ChunkedArray<T, ChunkBits>&& other) noexcept
+    {
+        swap(other);
+    }
+
+    ChunkedArray<T, ChunkBits>& operator=(ChunkedArray<T, ChunkBits> other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~ChunkedArray()
+    {
+        Clear();
+    }
+
+    T& Append(const T& item)
+    {
+        T& slot = Grow();
+        slot = item;
+        return slot;
+    }
+
+    T& Append(T&& item)
+    {
+        T& slot = Grow();
+        slot = std::move(item);
+        return slot;
+    }
+
+    int GetLength() const { return size; }
+    int GetChunkCount() const { return chunks.GetLength(); }
+
+    // Elements [chunk * ChunkSize, min(size, (chunk + 1) * ChunkSize)) are
+    // contiguous, so hot loops can walk a chunk as a plain array.
+    T* GetChunk(int chunk) { return chunks[chunk]; }
+    const T* GetChunk(int chunk) const { return chunks[chunk]; }
+
+    T& operator[](int index)
+    {
+        if (index < 0 || index >= size)
+            throw std::out_of_range("IndexOutOfRange");
+        return chunks[index >> ChunkBits][index & ChunkMask];
+    }
+
+    const T& operator[](int index) const
+    {
+        if (index < 0 || index >= size)
+            throw std::out_of_range("IndexOutOfRange");
+        return chunks[index >> ChunkBits][index & ChunkMask];
+    }
+
+    Iterator begin() { return Iterator(this, 0); }
+    Iterator end()   { return Iterator(this, size); }
+    ConstIterator begin() const { return ConstIterator(this, 0); }
+    ConstIterator end()   const { return ConstIterator(this, size); }
+
+    void Clear()
+    {
+        for (T* chunk : chunks)
+            delete[] chunk;
+        chunks.Clear();
+        size = 0;
+    }
+
+    void swap(ChunkedArray<T, ChunkBits>& other)
+    {
+        chunks.swap(other.chunks);
+        std::swap(size, other.size);
+    }
+
+private:
+    T& Grow()
+    {
+        if ((size >> ChunkBits) == chunks.GetLength())
+            chunks.Append(new T[ChunkSize]);
+        int index = size++;
+        return chunks[index >> ChunkBits][index & ChunkMask];
+    }
+
+    ArraySequence<T*> chunks;
+    int size = 0;
+};
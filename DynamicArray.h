@@ -27,6 +27,19 @@ public:
             data[i] = other.data[i];
     }
 
+    DynamicArray<T>& operator=(const DynamicArray<T>& other) {
+        if (this == &other)
+            return *this;
+        T* copy = other.capacity ? new T[other.capacity] : nullptr;
+        for (int i = 0; i < other.size; ++i)
+            copy[i] = other.data[i];
+        delete[] data;
+        data = copy;
+        size = other.size;
+        capacity = other.capacity;
+        return *this;
+    }
+
     ~DynamicArray() {
         delete[] data;
     }
@@ -63,6 +76,11 @@ public:
         size = newSize;
     }
 
+    // size 0, capacity kept
+    void Clear() {
+        size = 0;
+    }
+
     T* begin() { return data; }
     T* end()   { return data + size; }
     const T* begin() const { return data; }
@@ -0,0 +1,113 @@
+#include "ExitTable.h"
+
+using HexGeometry::withinSide;
+
+void ExitTable::Build(const HexGrid& grid, const HexNode* hex)
+{
+    const CellStore& cells = grid.cells;
+    q = hex->q;
+    r = hex->r;
+    revision = hex->revision;
+    built = true;
+    base = -1;
+    foreign.Clear();
+    grid.cellsInHex(hex, [&](int id) {
+        int hq, hr;
+        cells.HexOf(id, hq, hr);
+        if (hq == q && hr == r)
+            base = id - id % CellStore::BlockCells;
+        else
+            foreign.Append(id);
+    });
+
+    stride = CellStore::BlockCells + foreign.GetLength();
+    dist.Resize(6 * stride);
+    for (uint16_t& d : dist)
+        d = Unreachable;
+
+    // sides each cell has a corridor across; every other cell of the
+    // table lies in the hex
+    exits.Clear();
+    grid.cellsInHex(hex, [&](int id) {
+        uint8_t across = 0;
+        for (int d = 0; d < 4; ++d) {
+            const int nb = cells.Neighbor(id, d);
+            if (nb < 0 || Local(nb) >= 0)
+                continue;
+            for (int side = 0; side < 6; ++side)
+                if (!withinSide(side, q, r, cells.Pos(nb)))
+                    across |= uint8_t(1 << side);
+        }
+        if (across)
+            exits.Append({ id, across });
+    });
+
+    for (int side = 0; side < 6; ++side) {
+        uint16_t* to = dist.begin() + side * stride;
+        frontier.Clear();
+        for (const Exit& e : exits)
+            if (e.sides & (1 << side)) {
+                to[Local(e.id)] = 1;
+                frontier.Append(e.id);
+            }
+        for (int head = 0; head < frontier.GetLength(); ++head) {
+            const int v = frontier[head];
+            const uint16_t next = uint16_t(to[Local(v)] + 1);
+            for (int d = 0; d < 4; ++d) {
+                const int nb = cells.Neighbor(v, d);
+                const int at = nb < 0 ? -1 : Local(nb);
+                if (at >= 0 && to[at] == Unreachable) {
+                    to[at] = next;
+                    frontier.Append(nb);
+                }
+            }
+        }
+    }
+}
+
+bool ExitTable::IsCurrent(const HexNode* hex) const
+{
+    return built && hex->q == q && hex->r == r && hex->revision == revision;
+}
+
+int ExitTable::Local(int id) const
+{
+    if (base >= 0 && id >= base && id < base + CellStore::BlockCells)
+        return id - base;
+    for (int i = 0; i < foreign.GetLength(); ++i)
+        if (foreign[i] == id)
+            return CellStore::BlockCells + i;
+    return -1;
+}
+
+int ExitTable::Distance(int side, int id) const
+{
+    const int at = id < 0 ? -1 : Local(id);
+    if (at < 0 || dist[side * stride + at] == Unreachable)
+        return -1;
+    return dist[side * stride + at];
+}
+
+bool ExitTable::Route(const CellStore& cells, int id, int side, ArraySequence<int>& path) const
+{
+    path.Clear();
+    int left = Distance(side, id);
+    if (left < 0)
+        return false;
+
+    path.Append(id);
+    for (int v = id; left > 0; --left) {
+        for (int d = 0; d < 4; ++d) {
+            const int nb = cells.Neighbor(v, d);
+            if (nb < 0)
+                continue;
+            const bool across = !withinSide(side, q, r, cells.Pos(nb));
+            if (left == 1 ? across : !across && Distance(side, nb) == left - 1) {
+                v = nb;
+                break;
+            }
+        }
+        path.Append(v);
+    }
+    return true;
+}
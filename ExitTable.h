@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include "ArraySequence.h"
+#include "DynamicArray.h"
+#include "HexGrid.h"
+
+// Corridor distances from every cell of one hex to each of its six sides:
+// for side s, the number of steps that lead from the cell, through cells
+// of the hex, to the first cell lying across s. One reverse breadth-first
+// search per side fills the table; a route to a side is then a walk down
+// the distances, O(route length).
+class ExitTable {
+public:
+    static constexpr uint16_t Unreachable = 0xFFFF;
+
+    void Build(const HexGrid& grid, const HexNode* hex);
+    // built for this hex and its cells have not changed since
+    bool IsCurrent(const HexNode* hex) const;
+
+    // steps from id to the first cell across side, or -1
+    int Distance(int side, int id) const;
+    // Cells from id to the first cell across side, both included. Empty
+    // and false when no route leaves through that side.
+    bool Route(const CellStore& cells, int id, int side, ArraySequence<int>& path) const;
+
+private:
+    struct Exit {
+        int id;
+        uint8_t sides;
+    };
+
+    // index into one side's distances, -1 for a cell outside the hex
+    int Local(int id) const;
+
+    int q = 0;
+    int r = 0;
+    uint32_t revision = 0;
+    bool built = false;
+    int base = -1;                // first id of the hex's own block
+    ArraySequence<int> foreign;   // cells of the hex kept in other blocks
+    int stride = 0;
+    DynamicArray<uint16_t> dist;  // [side * stride + Local(id)]
+    ArraySequence<Exit> exits;
+    ArraySequence<int> frontier;
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Open-addressing hash from a packed 64-bit coordinate key ((a << 32) | b,
+// as built by cellKey and HexMap::Key) to a non-negative index. Slots sit
+// in one flat array and collide by linear probing; erase shifts the rest
+// of the probe run back, so there are no tombstones and lookups never
+// slow down after deletions. Find never inserts.
+class FlatIndex {
+public:
+    static constexpr int Empty = -1;
+
+    FlatIndex() { Rehash(MinCapacity); }
+
+    // Empty when key is not present
+    int Find(uint64_t key) const
+    {
+        for (uint64_t i = Home(key);; i = (i + 1) & mask) {
+            const Slot& s = table[i];
+            if (s.value == Empty)
+                return Empty;
+            if (s.key == key)
+                return s.value;
+        }
+    }
+
+    bool Contains(uint64_t key) const { return Find(key) != Empty; }
+
+    // Stores value under key, replacing an existing one. value >= 0.
+    void Insert(uint64_t key, int value)
+    {
+        if (uint64_t(count + 1) * 8 > (mask + 1) * 7)
+            Rehash(int(mask + 1) * 2);
+        for (uint64_t i = Home(key);; i = (i + 1) & mask) {
+            Slot& s = table[i];
+            if (s.value == Empty) {
+                s.key = key;
+                s.value = value;
+                ++count;
+                return;
+            }
+            if (s.key == key) {
+                s.value = value;
+                return;
+            }
+        }
+    }
+
+    bool Erase(uint64_t key)
+    {
+        uint64_t i = Home(key);
+        for (;; i = (i + 1) & mask) {
+            const Slot& s = table[i];
+            if (s.value == Empty)
+                return false;
+            if (s.key == key)
+                break;
+        }
+        // pull later members of the run into the hole unless that would
+        // move them in front of their home slot
+        for (uint64_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+            Slot& s = table[j];
+            if (s.value == Empty)
+                break;
+            const uint64_t home = Home(s.key);
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                table[i] = s;
+                i = j;
+            }
+        }
+        table[i] = Slot();
+        --count;
+        return true;
+    }
+
+    void Reserve(int keys)
+    {
+        int capacity = int(mask + 1);
+        while (keys * 8 > capacity * 7)
+            capacity *= 2;
+        if (capacity > int(mask + 1))
+            Rehash(capacity);
+    }
+
+    void Clear()
+    {
+        table.reset();
+        Rehash(MinCapacity);
+    }
+
+    int GetLength() const { return count; }
+    int GetCapacity() const { return int(mask + 1); }
+    size_t MemoryBytes() const { return size_t(mask + 1) * sizeof(Slot); }
+
+private:
+    static constexpr int MinCapacity = 16;
+
+    struct Slot {
+        uint64_t key = 0;
+        int value = Empty;
+    };
+
+    // folds the two packed halves together, then Fibonacci hashing takes
+    // the well-mixed top bits
+    uint64_t Home(uint64_t key) const
+    {
+        key ^= key >> 32;
+        return (key * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    void Rehash(int capacity)
+    {
+        std::unique_ptr<Slot[]> old(new Slot[capacity]);
+        old.swap(table);
+        const uint64_t oldCapacity = old ? mask + 1 : 0;
+        mask = uint64_t(capacity) - 1;
+        shift = 64;
+        for (int c = capacity; c > 1; c >>= 1)
+            --shift;
+        count = 0;
+        for (uint64_t i = 0; i < oldCapacity; ++i)
+            if (old[i].value != Empty)
+                Insert(old[i].key, old[i].value);
+    }
+
+    std::unique_ptr<Slot[]> table;
+    uint64_t mask = 0;
+    int shift = 64;
+    int count = 0;
+};
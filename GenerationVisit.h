@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include "CellStore.h"
+#include "DynamicArray.h"
+
+// Per-cell visit marks used by HexGenerator. Cell ids come in blocks of
+// CellStore::BlockCells and one generation only touches the blocks of a
+// hex and its neighbours, so marks live in a handful of block-sized pages
+// handed out on first touch. Starting a new generation is O(1): pages
+// assigned in older epochs simply read as unassigned, and a page is
+// cleared when it is handed out again.
+class GenerationVisit {
+public:
+    static constexpr int PageCells = CellStore::BlockCells;
+
+    void Begin(int cellCount)
+    {
+        if (++epoch == 0) {
+            for (int i = 0; i < table.GetSize(); ++i)
+                table[i] = Page();
+            epoch = 1;
+        }
+        Grow((cellCount + PageCells - 1) / PageCells);
+        used = 0;
+    }
+
+    int Get(int id) const
+    {
+        const Slot* s = Find(id);
+        return s ? s->value : 0;
+    }
+
+    void Set(int id, int value)
+    {
+        Touch(id).value = int16_t(value);
+    }
+
+    bool InPlanB(int id) const
+    {
+        const Slot* s = Find(id);
+        return s && s->planB;
+    }
+
+    void MarkPlanB(int id)
+    {
+        Touch(id).planB = 1;
+    }
+
+private:
+    struct Slot {
+        int16_t value = 0;
+        uint8_t planB = 0;
+    };
+
+    // where the marks of one cell block live in this epoch
+    struct Page {
+        uint32_t stamp = 0;
+        int offset = 0;
+    };
+
+    void Grow(int blocks)
+    {
+        if (blocks > table.GetSize())
+            table.Resize(blocks);
+    }
+
+    const Slot* Find(int id) const
+    {
+        const int block = id / PageCells;
+        if (block >= table.GetSize() || table[block].stamp != epoch)
+            return nullptr;
+        return &slots[table[block].offset + id % PageCells];
+    }
+
+    Slot& Touch(int id)
+    {
+        const int block = id / PageCells;
+        Grow(block + 1);
+        Page& page = table[block];
+        if (page.stamp != epoch) {
+            page.stamp = epoch;
+            page.offset = used * PageCells;
+            if (++used * PageCells > slots.GetSize())
+                slots.Resize(used * PageCells);
+            for (int i = 0; i < PageCells; ++i)
+                slots[page.offset + i] = Slot();
+        }
+        return slots[page.offset + id % PageCells];
+    }
+
+    DynamicArray<Page> table;
+    DynamicArray<Slot> slots;
+    int used = 0;
+    uint32_t epoch = 0;
+};
@@ -1,96 +1,60 @@
 #include "HexGenerator.h"
-#include <unordered_set>
-#include <unordered_map>
+#include "DynamicArray.h"
+#include "GenerationVisit.h"
+#include "HexRandom.h"
+#include <atomic>
 #include <cstdlib>
 #include <cmath>
-#include <random>
 #include <queue>
+#include <thread>
 
 
-std::mt19937 rng(std::random_device{}());
-
 const float CONTINUE_PROB = 0.40f;
 
-const QPointF dirVec[4] = {
-    {  1,  0 },  // R
-    { -1,  0 },  // L
-    {  0, -1 },  // U
-    {  0,  1 }   // D
-};
-
-int opposite(int d) { return d ^ 1; }
-
-uint64_t key(const QPointF& p, float step)
-{
-    int x = int(std::round(p.x() / step));
-    int y = int(std::round(p.y() / step));
-    return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
-}
+using HexGeometry::dirStep;
 
-const float pi = acos(-1);
-const QPointF sideNormal[6] = {
-    {  1.0f,  0.0f },
-    {  0.5f,  std::cos(pi/6) },
-    { -0.5f,  std::cos(pi/6) },
-    { -1.0f,  0.0f },
-    { -0.5f, -std::cos(pi/6)},
-    {  0.5f, -std::cos(pi/6) }
-};
-
-bool boundarySide(const QPointF& p,
-                  float hexRadius,
-                  HexNode* n,
+// sides of the hex that p lies beyond; true if one of them borders an
+// already generated neighbour
+bool boundarySide(const GenRecord& rec,
+                  const HexNode* hex,
+                  const CellPos& p,
                   ArraySequence<int>& sides)
 {
-    const float d = hexRadius * std::cos(pi / 6);
     bool hasGenerate = false;
     for (int i = 0; i < 6; ++i)
     {
-        if (QPointF::dotProduct(p, sideNormal[i]) >= d)
+        if (!HexGeometry::withinSide(i, hex->q, hex->r, p))
         {
             sides.Append(i);
-            HexNode* neigh = n->neigh[i];
-            if (neigh && neigh->state == HexState::Generated)
+            if (rec.generatedMask & (1 << i))
                 hasGenerate = true;
         }
     }
     return hasGenerate;
 }
 
-bool pointInsideHex(const QPointF& p, float hexRadius)
-{
-    const float d = hexRadius * std::cos(pi/6);
-    for (int i = 0; i < 6; ++i)
-        if (QPointF::dotProduct(p, sideNormal[i]) > d)
-            return false;
-    return true;
-}
-
-QPointF axialToPixel(int q, int r, float hexRadius)
+bool pointInsideHex(const HexNode* hex, const CellPos& p)
 {
-    return {
-        hexRadius * (2 * cos(pi/6) * q + cos(pi/6) * r),
-        hexRadius * (1.5f * r)
-    };
+    return HexGeometry::insideHex(hex->q, hex->r, p);
 }
 
-bool isAppleInHex(const QPointF& hexCenter, const QPointF& apple, float hexRadius)
-{
-    QPointF local  = apple - hexCenter;
-    return pointInsideHex(local, hexRadius);
-}
-
-bool bfsFrom(HexGrid& grid, HexNode* hex, const QPointF& hexCenter, int startId,
-             bool connectOnly, const float hexRadius, const float step, int visit,
-             std::unordered_map<int, int>& visited,  std::unordered_set<int>& visitedPlanB, int& countEdge)
+// Stops when a whole pass over planB offered no unvisited cell and no open
+// border, so no later pass could either. Returns false when that happens
+// to a connect-only walk that never linked to anything: its cells are
+// sealed off from every other cell.
+bool bfsFrom(HexGrid& grid, HexNode* hex, const GenRecord& rec, int startId,
+             bool connectOnly, int visit,
+             GenerationVisit& visited, HexRandom& rng, int& countEdge)
 {
 
     std::queue<int> q, planB;
+    bool inPass = false;
+    bool canGrow = false;
 
-    int maxCountEdge = 300 + rand() % (1000 - 300 + 1);
+    int maxCountEdge = 300 + rng.Range(1000 - 300 + 1);
     bool beginConnect = connectOnly;
-    visited[startId] = visit;
-    visitedPlanB.insert(startId);
+    visited.Set(startId, visit);
+    visited.MarkPlanB(startId);
     planB.push(startId);
     q.push(startId);
     while (true)
@@ -98,11 +62,16 @@ bool bfsFrom(HexGrid& grid, HexNode* hex, const QPointF& hexCenter, int startId,
     {
 
         if (q.empty()){
+            if (inPass && !canGrow){
+                return !connectOnly;
+            }
             q = planB;
+            inPass = true;
+            canGrow = false;
         }
 
         int v = q.front(); q.pop();
-        bool haveWay = !pointInsideHex(grid.maze[v].pos - hexCenter, hexRadius);
+        bool haveWay = !pointInsideHex(hex, grid.cells.Pos(v));
         if (connectOnly != beginConnect || haveWay)
         {
             if (connectOnly == false &&  countEdge > maxCountEdge){
@@ -118,36 +87,44 @@ bool bfsFrom(HexGrid& grid, HexNode* hex, const QPointF& hexCenter, int startId,
 
 
         std::array<int,4> order = {0,1,2,3};
-        std::shuffle(order.begin(), order.end(), rng);
+        rng.Shuffle(order);
 
 
         for (int d : order)
         {
-            QPointF np = grid.maze[v].pos + dirVec[d] * step;
+            CellPos np = grid.cells.Pos(v) + dirStep[d];
 
-            if (!pointInsideHex(np - hexCenter, hexRadius))
+            if (!pointInsideHex(hex, np))
             {
-                if ((float)rand() / RAND_MAX < CONTINUE_PROB){
+                if (rng.Unit() < CONTINUE_PROB){
+                    if (inPass && !canGrow){
+                        ArraySequence<int> sides;
+                        canGrow = !boundarySide(rec, hex, np, sides);
+                    }
                     continue;
                 }
                 ArraySequence<int> sides;
-                if (boundarySide(np - hexCenter, hexRadius, hex, sides)){
+                if (boundarySide(rec, hex, np, sides)){
                     continue;
                 }
+                canGrow = true;
                 for (auto& side: sides){
-                    HexNode* neigh = hex->neigh[side];
-                    int to = grid.addCell(np, step);
-                    int back = opposite(d);
-                    grid.maze[v].edge[d] = to;
-                    grid.maze[to].edge[back] = v;
+                    HexNode* neigh = grid.neighbor(hex, side);
+                    int to = grid.addCell(np);
+                    grid.cells.Link(v, d, to);
                     ++countEdge;
-                    visited[to] = visit;
+                    visited.Set(to, visit);
                     q.push(to);
                     if (connectOnly){
                         connectOnly = false;
+                        PendingApples& pending = grid.pendingApples(neigh);
                         for (int i = 0; i < 3; ++i){
-                            if (neigh->pending_apple[i] == QPointF()){
-                                neigh->pending_apple[i] = np;
+                            // a replayed hex finds its own earlier write
+                            if (pending[i] == np){
+                                break;
+                            }
+                            if (pending[i] == NoCell){
+                                pending[i] = np;
                                 break;
                             }
                         }
@@ -159,35 +136,37 @@ bool bfsFrom(HexGrid& grid, HexNode* hex, const QPointF& hexCenter, int startId,
 
             }
 
-            int to = grid.addCell(np, step);
-            if ((float)rand() / RAND_MAX < CONTINUE_PROB)
+            int to = grid.addCell(np);
+            if (rng.Unit() < CONTINUE_PROB)
             {
-                if (!visitedPlanB.count(v)){
-                    visitedPlanB.insert(v);
+                if (!visited.InPlanB(v)){
+                    visited.MarkPlanB(v);
                     planB.push(v);
                 }
+                canGrow |= visited.Get(to) != visit;
                 continue;
             }
-            if (connectOnly && visited[to] != 0 && visited[to] != visit){
+            int mark = visited.Get(to);
+            if (connectOnly && mark != 0 && mark != visit){
                 connectOnly = false;
-                grid.maze[v].edge[d] = to;
-                grid.maze[to].edge[opposite(d)] = v;
+                canGrow = true;
+                grid.cells.Link(v, d, to);
 
                 ++countEdge;
-                if (visited[to] == 1){
+                if (mark == 1){
                     q.push(to);
-                    visited[to] = visit;
+                    visited.Set(to, visit);
                 }
                 continue;
 
             }
-            if (visited[to] == visit)
+            if (mark == visit)
                 continue;
 
-            grid.maze[v].edge[d] = to;
-            grid.maze[to].edge[opposite(d)] = v;
+            canGrow = true;
+            grid.cells.Link(v, d, to);
             ++countEdge;
-            visited[to] = visit;
+            visited.Set(to, visit);
             q.push(to);
         }
 
@@ -195,40 +174,35 @@ bool bfsFrom(HexGrid& grid, HexNode* hex, const QPointF& hexCenter, int startId,
     return true;
 }
 
-void HexGenerator::generate(
-    HexGrid& grid,
-    HexNode* hex,
-    const float hexRadius,
-    const QPointF& start,
-    const std::array<QPointF, 3>& apples
-    )
+// False when the hex could not be joined to the maze: no corridor led
+// into its start and the walk from it was sealed in. The cells it carved
+// stay, but the hex must not count as generated.
+static bool run(HexGrid& grid, HexNode* hex, const GenRecord& rec, bool replay)
 {
-    hex->state = HexState::Generated;
+    HexRandom rng(grid.worldSeed(), hex->q, hex->r, cellKey(rec.start));
 
-    const float step = hexRadius * 0.05f;
-    QPointF hexCenter = axialToPixel(hex->q, hex->r, hexRadius);
 
-
-    std::unordered_map<int, int> visited;
-    std::unordered_set<int> visitedPlanB;
-    visited.reserve(200000);
-    visitedPlanB.reserve(200000);
+    // reused across calls: only grows with the cell id space, cleared by a
+    // new epoch
+    static thread_local GenerationVisit visited;
+    visited.Begin(grid.cells.IdLimit());
     int countEdge = 0;
-    for (int i = 0; i < grid.maze.GetLength(); ++i) {
-        if (pointInsideHex(grid.maze[i].pos - hexCenter, hexRadius)) {
-            visited[i] = 1;
-        }
+    for (const CellPos& p : rec.inbound) {
+        visited.Set(grid.addCell(p), 1);
     }
 
     int visit = 2;
-    int startId = grid.addCell(start, step);
-    bfsFrom(grid, hex, hexCenter, startId, (hex->knownBeforeGen == 6? true : false), hexRadius, step, visit++, visited, visitedPlanB, countEdge);
+    int startId = grid.addCell(rec.start);
+    if (!bfsFrom(grid, hex, rec, startId, rec.connectOnly, visit++, visited, rng, countEdge) && !rec.entered){
+        grid.markChanged(hex);
+        return false;
+    }
 
     for (int i = 0; i < 3; ++i){
-        if (apples[i] != zero && isAppleInHex(hexCenter, apples[i], hexRadius)){
-            int appleId = grid.addCell(apples[i], step);
-            if (visited[appleId] == 0){
-                bfsFrom(grid, hex, hexCenter, appleId, true, hexRadius, step, visit++, visited, visitedPlanB, countEdge);
+        if (rec.apples[i] != NoCell){
+            int appleId = grid.addCell(rec.apples[i]);
+            if (visited.Get(appleId) == 0){
+                bfsFrom(grid, hex, rec, appleId, true, visit++, visited, rng, countEdge);
             }
 
         }
@@ -236,17 +210,238 @@ void HexGenerator::generate(
 
 
     for (int i =0; i < 3; ++i){
-        if (hex->pending_apple[i] != QPointF()){
-            int appleId = grid.addCell(hex->pending_apple[i], step);
-            if (visited[appleId] == 1){
-                bfsFrom(grid, hex, hexCenter, appleId, true, hexRadius, step, visit++, visited, visitedPlanB, countEdge);
+        if (rec.pending[i] != NoCell){
+            int appleId = grid.addCell(rec.pending[i]);
+            if (visited.Get(appleId) == 1){
+                bfsFrom(grid, hex, rec, appleId, true, visit++, visited, rng, countEdge);
+            }
+        }
+    }
+
+    if (rec.linkInbound){
+        // Inbound cells no walk reached would stay cut off from the hex.
+        // Forgotten as inbound, each walks until it meets a walked cell,
+        // so it cannot settle for another stray one.
+        ArraySequence<int> missed;
+        for (const CellPos& p : rec.inbound){
+            int id = grid.cells.Find(p);
+            if (visited.Get(id) == 1){
+                visited.Set(id, 0);
+                missed.Append(id);
+            }
+        }
+        for (int id : missed){
+            if (visited.Get(id) == 0)
+                bfsFrom(grid, hex, rec, id, true, visit++, visited, rng, countEdge);
+        }
+    }
+
+
+    grid.markChanged(hex);
+    if (replay)
+        return true;
+    for (int i = 0; i < 6; ++i){
+        ++grid.neighbor(hex, i)->knownBeforeGen;
+    }
+    return true;
+}
+
+GenRecord HexGenerator::capture(
+    HexGrid& grid,
+    HexNode* hex,
+    const CellPos& start,
+    const std::array<CellPos, 3>& apples
+    )
+{
+    GenRecord rec;
+    rec.start = start;
+    for (int i = 0; i < 3; ++i){
+        bool inHex = apples[i] != NoCell && pointInsideHex(hex, apples[i]);
+        rec.apples[i] = inHex ? apples[i] : NoCell;
+    }
+    rec.pending = grid.pendingApples(hex);
+    rec.connectOnly = hex->knownBeforeGen == 6;
+    for (int i = 0; i < 6; ++i){
+        HexNode* neigh = grid.neighbor(hex, i);
+        if (neigh && neigh->state == HexState::Generated)
+            rec.generatedMask |= 1 << i;
+    }
+    grid.cellsInHex(hex, [&](int id){
+        rec.inbound.Append(grid.cells.Pos(id));
+    });
+    // read here: a detached run has the cells but none of their corridors
+    if (int startId = grid.cells.Find(start); startId >= 0){
+        for (int d = 0; d < 4; ++d)
+            rec.entered |= grid.cells.HasEdge(startId, d) && !pointInsideHex(hex, start + dirStep[d]);
+    }
+    return rec;
+}
+
+bool HexGenerator::sameInputs(const GenRecord& a, const GenRecord& b)
+{
+    if (a.start != b.start || a.apples != b.apples || a.pending != b.pending ||
+        a.generatedMask != b.generatedMask || a.connectOnly != b.connectOnly ||
+        a.linkInbound != b.linkInbound || a.entered != b.entered ||
+        a.inbound.GetLength() != b.inbound.GetLength())
+        return false;
+    for (int i = 0; i < a.inbound.GetLength(); ++i){
+        if (a.inbound[i] != b.inbound[i])
+            return false;
+    }
+    return true;
+}
+
+bool HexGenerator::generate(
+    HexGrid& grid,
+    HexNode* hex,
+    const CellPos& start,
+    const std::array<CellPos, 3>& apples
+    )
+{
+    return generate(grid, hex, capture(grid, hex, start, apples));
+}
+
+bool HexGenerator::generate(HexGrid& grid, HexNode* hex, const GenRecord& rec)
+{
+    if (!run(grid, hex, rec, false))
+        return false;
+    grid.markGenerated(hex);
+    grid.addRecord(hex) = rec;
+    return true;
+}
+
+void HexGenerator::generateDetached(int q, int r, const GenRecord& rec,
+                                    uint64_t seed, GenResult& out)
+{
+    HexGrid scratch(seed);
+    HexNode* hex = scratch.getOrCreate(q, r);
+    scratch.ensureNeighbors(hex);
+    out.joined = run(scratch, hex, rec, true);
+
+    out.q = q;
+    out.r = r;
+    out.rec = rec;
+    out.cells.Clear();
+    for (int id = 0; id < scratch.cells.IdLimit(); ++id){
+        if (scratch.cells.Contains(id))
+            out.cells.Append({ scratch.cells.Pos(id), scratch.cells.Edges(id) });
+    }
+    for (int i = 0; i < 6; ++i){
+        out.neighborPending[i] = scratch.pendingApples(scratch.neighbor(hex, i));
+    }
+}
+
+bool HexGenerator::commit(HexGrid& grid, HexNode* hex, const GenResult& res)
+{
+    DynamicArray<int> ids(res.cells.GetLength());
+    for (int i = 0; i < res.cells.GetLength(); ++i){
+        ids[i] = grid.addCell(res.cells[i].pos);
+    }
+    grid.markChanged(hex);
+    // only edges the generator placed; links of older cells stay as they are
+    for (int i = 0; i < res.cells.GetLength(); ++i){
+        for (int d = 0; d < 4; ++d){
+            if (res.cells[i].edges & (1 << d))
+                grid.cells.Link(ids[i], d, grid.cells.Find(res.cells[i].pos + dirStep[d]));
+        }
+    }
+    if (!res.joined)
+        return false;
+    grid.markGenerated(hex);
+    grid.addRecord(hex) = res.rec;
+
+    for (int s = 0; s < 6; ++s){
+        HexNode* neigh = grid.neighbor(hex, s);
+        for (const CellPos& np : res.neighborPending[s]){
+            if (np == NoCell)
+                continue;
+            PendingApples& pending = grid.pendingApples(neigh);
+            for (int i = 0; i < 3; ++i){
+                if (pending[i] == np){
+                    break;
+                }
+                if (pending[i] == NoCell){
+                    pending[i] = np;
+                    break;
+                }
             }
         }
+        ++neigh->knownBeforeGen;
     }
+    return true;
+}
 
+CellPos HexGenerator::entryPoint(const HexGrid& grid, const HexNode* hex)
+{
+    // the first cell, in cellsInHex order, with a corridor from outside
+    CellPos entry = NoCell;
+    grid.cellsInHex(hex, [&](int id){
+        const CellPos p = grid.cells.Pos(id);
+        for (int d = 0; d < 4 && entry == NoCell; ++d){
+            if (grid.cells.HasEdge(id, d) && !pointInsideHex(hex, p + dirStep[d]))
+                entry = p;
+        }
+    });
+    if (entry != NoCell)
+        return entry;
 
-    for (auto& i: hex->neigh){
-        ++i->knownBeforeGen;
+    using namespace HexGeometry;
+    return { int(std::lround(centerX(hex->q, hex->r, LatticeRadius))),
+             int(std::lround(centerY(hex->r, LatticeRadius))) };
+}
+
+int HexGenerator::generateRegion(HexGrid& grid, HexNode* center, int radius, int threads)
+{
+    // (q - r) mod 3 colours the lattice so that no two hexes of one colour
+    // touch. Hexes of a wave then neither read nor write each other's
+    // cells, pending apples or counters, and can be generated side by side.
+    ArraySequence<HexNode*> waves[3];
+    for (int dq = -radius; dq <= radius; ++dq){
+        for (int dr = std::max(-radius, -dq - radius); dr <= std::min(radius, -dq + radius); ++dr){
+            HexNode* hex = grid.getOrCreate(center->q + dq, center->r + dr);
+            if (hex->state == HexState::Generated)
+                continue;
+            waves[((hex->q - hex->r) % 3 + 3) % 3].Append(hex);
+        }
     }
 
+    int generated = 0;
+    for (ArraySequence<HexNode*>& wave : waves){
+        const int count = wave.GetLength();
+        DynamicArray<GenRecord> recs(count);
+        DynamicArray<GenResult> results(count);
+        for (int i = 0; i < count; ++i){
+            grid.ensureNeighbors(wave[i]);
+            recs[i] = capture(grid, wave[i], entryPoint(grid, wave[i]));
+            // a wave starts next to hexes no player connected to anything
+            recs[i].linkInbound = true;
+        }
+
+        std::atomic<int> next{0};
+        auto work = [&] {
+            for (int i = next++; i < count; i = next++)
+                generateDetached(wave[i]->q, wave[i]->r, recs[i], grid.worldSeed(), results[i]);
+        };
+        DynamicArray<std::thread> pool(std::max(0, std::min(threads, count) - 1));
+        for (std::thread& t : pool)
+            t = std::thread(work);
+        work();
+        for (std::thread& t : pool)
+            t.join();
+
+        // merged in a fixed order, so ids come out the same for any pool size
+        for (int i = 0; i < count; ++i)
+            generated += commit(grid, wave[i], results[i]);
+    }
+    return generated;
+}
+
+void HexGenerator::regenerate(HexGrid& grid, HexNode* hex)
+{
+    GenRecord* rec = grid.record(hex);
+    if (!rec || rec->resident)
+        return;
+
+    grid.markResident(hex);
+    run(grid, hex, *rec, true);
 }
@@ -1,15 +1,68 @@
 #pragma once
 #include "HexGrid.h"
-#include <QPointF>
-static QPointF zero = {0.666f, 0.666f};
+
+// A cell the detached generator touched and the corridors it opened there.
+struct GenCell
+{
+    CellPos pos;
+    uint8_t edges = 0;
+};
+
+// A hex generated away from the live grid.
+struct GenResult
+{
+    int q = 0;
+    int r = 0;
+    GenRecord rec;
+    ArraySequence<GenCell> cells;
+    std::array<PendingApples, 6> neighborPending;
+    bool joined = true;  // see HexGenerator::generate
+};
+
 class HexGenerator
 {
 public:
-    static void generate(
+    // False when the hex could not be joined to the maze (no corridor led
+    // into its start and every side was closed): the carved cells stay, but the
+    // hex is left Linked and gets no record.
+    static bool generate(
+        HexGrid& grid,
+        HexNode* hex,
+        const CellPos& start,
+        const std::array<CellPos, 3>& apples = {NoCell, NoCell, NoCell}
+        );
+    static bool generate(HexGrid& grid, HexNode* hex, const GenRecord& rec);
+
+    // Inputs generate would use for the hex right now. Needs the
+    // neighbours of the hex to exist.
+    static GenRecord capture(
         HexGrid& grid,
         HexNode* hex,
-        const float hexRadius,
-        const QPointF& start,
-        const std::array<QPointF, 3>& apples = {zero, zero, zero}
+        const CellPos& start,
+        const std::array<CellPos, 3>& apples = {NoCell, NoCell, NoCell}
         );
+    static bool sameInputs(const GenRecord& a, const GenRecord& b);
+
+    // Runs generation in a private grid; touches no shared state, so it
+    // is safe on any thread.
+    static void generateDetached(int q, int r, const GenRecord& rec,
+                                 uint64_t seed, GenResult& out);
+    // Publishes a detached result. The maze ends up exactly as if
+    // generate had been called with the same record, return value included.
+    static bool commit(HexGrid& grid, HexNode* hex, const GenResult& res);
+
+    // Generates every hex within radius of center that is not generated
+    // yet, using up to threads workers. The result does not depend on the
+    // thread count. Returns the number of hexes generated; see generate for
+    // the ones that are not.
+    static int generateRegion(HexGrid& grid, HexNode* center, int radius, int threads);
+
+    // Where a hex is entered when no player walks in: through a corridor a
+    // generated neighbour already pushed into it, else the lattice point
+    // nearest its center.
+    static CellPos entryPoint(const HexGrid& grid, const HexNode* hex);
+
+    // Rebuilds the cells of an evicted hex from its GenRecord. The result
+    // is identical to the original generation.
+    static void regenerate(HexGrid& grid, HexNode* hex);
 };
@@ -0,0 +1,115 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+// Shared hex/lattice geometry. Cells sit on an integer lattice, one unit
+// per step (hexRadius / LatticeRadius when drawn); a hex is pointy-top
+// with a circumradius of LatticeRadius steps and its center at
+//     ( LatticeRadius * sqrt3 * (q + r/2),  LatticeRadius * 1.5 * r ).
+// Membership is decided exactly in integers and is closed on every side:
+// a cell lying on a border belongs to both hexes.
+
+// A cell on the lattice, in steps from the world origin.
+struct CellPos
+{
+    int x = 0;
+    int y = 0;
+
+    constexpr CellPos operator+(const CellPos& o) const { return { x + o.x, y + o.y }; }
+    constexpr bool operator==(const CellPos& o) const { return x == o.x && y == o.y; }
+    constexpr bool operator!=(const CellPos& o) const { return !(*this == o); }
+};
+
+// "no position": apples not in a hex, no goal set
+constexpr CellPos NoCell = { INT32_MIN, INT32_MIN };
+
+namespace HexGeometry
+{
+
+constexpr int LatticeRadius = 20;
+constexpr double Sqrt3 = 1.7320508075688772;
+
+// 0 Right, 1 Down-Right, 2 Down-Left, 3 Left, 4 Up-Left, 5 Up-Right
+constexpr int hexDq[6] = { +1,  0, -1, -1,  0, +1 };
+constexpr int hexDr[6] = {  0, +1, +1,  0, -1, -1 };
+
+// one lattice step per corridor direction: 0 R, 1 L, 2 U, 3 D
+constexpr CellPos dirStep[4] = { { 1, 0 }, { -1, 0 }, { 0, -1 }, { 0, 1 } };
+
+// a <= sqrt(3) * k without leaving the integers; both sides are never
+// equal unless a == k == 0
+constexpr bool leSqrt3(int64_t a, int64_t k)
+{
+    if (k >= 0)
+        return a <= 0 || a * a <= 3 * k * k;
+    return a <= 0 && a * a >= 3 * k * k;
+}
+
+constexpr bool geSqrt3(int64_t a, int64_t k)
+{
+    return leSqrt3(-a, -k);
+}
+
+// False when (x, y) lies strictly beyond side `side` of hex (q, r).
+// Each test is the side's half plane multiplied through by 2.
+constexpr bool withinSide(int side, int q, int r, int x, int y)
+{
+    const int64_t R = LatticeRadius;
+    const int64_t x2 = 2 * int64_t(x);
+    switch (side) {
+    case 0:  return leSqrt3(x2, R * (2 * q + r + 1));
+    case 1:  return leSqrt3(x2, 2 * (R * (q + 2 * r + 1) - y));
+    case 2:  return geSqrt3(x2, 2 * (R * (q - r - 1) + y));
+    case 3:  return geSqrt3(x2, R * (2 * q + r - 1));
+    case 4:  return geSqrt3(x2, 2 * (R * (q + 2 * r - 1) - y));
+    default: return leSqrt3(x2, 2 * (R * (q - r + 1) + y));
+    }
+}
+
+constexpr bool insideHex(int q, int r, int x, int y)
+{
+    for (int i = 0; i < 6; ++i)
+        if (!withinSide(i, q, r, x, y))
+            return false;
+    return true;
+}
+
+constexpr bool withinSide(int side, int q, int r, const CellPos& p)
+{
+    return withinSide(side, q, r, p.x, p.y);
+}
+
+constexpr bool insideHex(int q, int r, const CellPos& p)
+{
+    return insideHex(q, r, p.x, p.y);
+}
+
+// Hex whose center is nearest to (x, y) by cube rounding. Only picks a
+// candidate; the exact answer comes from insideHex.
+inline void nearestHex(int x, int y, int& q, int& r)
+{
+    double fq = (Sqrt3 / 3.0 * x - y / 3.0) / LatticeRadius;
+    double fr = (2.0 / 3.0 * y) / LatticeRadius;
+    double fs = -fq - fr;
+    double rq = std::round(fq), rr = std::round(fr), rs = std::round(fs);
+    double dq = std::abs(rq - fq), dr = std::abs(rr - fr), ds = std::abs(rs - fs);
+    if (dq > dr && dq > ds)
+        rq = -rr - rs;
+    else if (dr > ds)
+        rr = -rq - rs;
+    q = int(rq);
+    r = int(rr);
+}
+
+// Hex center in world units for a hex of circumradius hexRadius.
+inline double centerX(int q, int r, double hexRadius)
+{
+    return hexRadius * Sqrt3 * (q + r * 0.5);
+}
+
+inline double centerY(int r, double hexRadius)
+{
+    return hexRadius * 1.5 * r;
+}
+
+}
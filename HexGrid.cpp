@@ -1,49 +1,74 @@
 #include "HexGrid.h"
+#include <cmath>
 
-static const int dq[6] = { +1,  0, -1, -1,  0, +1 };
-static const int dr[6] = {  0, +1, +1,  0, -1, -1 };
-// Right
-// RightDown
-// LeftDown
-// Left
-// LeftUp
-// RightUp
+using HexGeometry::hexDq;
+using HexGeometry::hexDr;
 
-HexGrid::HexGrid()
+HexGrid::HexGrid(uint64_t seed)
+    : seed(seed)
 {
-    start = createNode(0, 0);
-    start->state = HexState::Generated;
-    ensureNeighbors(start);
+    HexNode* n = createNode(0, 0);
+    markGenerated(n);
+    start = n->id;
+    ensureNeighbors(n);
+}
+
+uint64_t HexGrid::worldSeed() const
+{
+    return seed;
 }
 
 HexNode* HexGrid::root()
 {
-    return start;
+    return node(start);
 }
 
-const LazySequence<HexNode*>& HexGrid::all() const
+const ChunkedArray<HexNode>& HexGrid::all() const
 {
     return nodes;
 }
 
+HexNode* HexGrid::node(HexId id)
+{
+    return id == NoHex ? nullptr : &nodes[int(id)];
+}
+
+HexNode* HexGrid::neighbor(const HexNode* n, int side)
+{
+    return node(n->neigh[side]);
+}
+
+PendingApples& HexGrid::pendingApples(const HexNode* n)
+{
+    if (PendingApples* p = pending.Find(n->q, n->r))
+        return *p;
+    return pending.Insert(n->q, n->r, { NoCell, NoCell, NoCell });
+}
+
 HexNode* HexGrid::createNode(int q, int r)
 {
-    HexNode* n = new HexNode;
-    n->q = q;
-    n->r = r;
-    nodes = *nodes.Append(n);
+    HexNode n;
+    n.q = q;
+    n.r = r;
+    n.id = HexId(nodes.GetLength());
+    byAxial.Insert(q, r, n.id);
+    frontierSlot.Append(-1);
+    residentSlot.Append(-1);
+    listAdd(frontier, frontierSlot, n.id);
+
+    return &nodes.Append(n);
+}
 
-    return n;
+HexNode* HexGrid::find(int q, int r)
+{
+    HexId* id = byAxial.Find(q, r);
+    return id ? node(*id) : nullptr;
 }
 
 HexNode* HexGrid::getOrCreate(int q, int r)
 {
-    int N = nodes.GetMaterializedCount();
-    for (int i = 0; i < N; ++i) {
-        HexNode* n = nodes.Get(i);
-        if (n->q == q && n->r == r)
-            return n;
-    }
+    if (HexNode* n = find(q, r))
+        return n;
     return createNode(q, r);
 }
 
@@ -51,12 +76,201 @@ void HexGrid::ensureNeighbors(HexNode* n)
 {
     for (int i = 0; i < 6; ++i)
     {
-        if (n->neigh[i]) continue;
-        int nq = n->q + dq[i];
-        int nr = n->r + dr[i];
+        if (n->neigh[i] != NoHex) continue;
+        int nq = n->q + hexDq[i];
+        int nr = n->r + hexDr[i];
 
         HexNode* other = getOrCreate(nq, nr);
-        n->neigh[i] = other;
-        other->neigh[(i + 3) % 6] = n;
+        n->neigh[i] = other->id;
+        other->neigh[(i + 3) % 6] = n->id;
+    }
+}
+
+void HexGrid::markGenerated(HexNode* n)
+{
+    n->state = HexState::Generated;
+    listRemove(frontier, frontierSlot, n->id);
+    listAdd(resident, residentSlot, n->id);
+}
+
+void HexGrid::listAdd(ArraySequence<HexId>& list, ArraySequence<int>& slot, HexId id)
+{
+    if (slot[int(id)] >= 0)
+        return;
+    slot[int(id)] = list.GetLength();
+    list.Append(id);
+}
+
+void HexGrid::listRemove(ArraySequence<HexId>& list, ArraySequence<int>& slot, HexId id)
+{
+    const int at = slot[int(id)];
+    if (at < 0)
+        return;
+    const HexId moved = list.GetLast();
+    list[at] = moved;
+    slot[int(moved)] = at;
+    list.RemoveLast();
+    slot[int(id)] = -1;
+}
+
+int HexGrid::frontierSize() const
+{
+    return frontier.GetLength();
+}
+
+HexNode* HexGrid::frontierHex(int i)
+{
+    return node(frontier[i]);
+}
+
+void HexGrid::markChanged(HexNode* n)
+{
+    ++changes;
+    ++n->revision;
+    for (int i = 0; i < 6; ++i)
+        if (HexNode* other = node(n->neigh[i]))
+            ++other->revision;
+}
+
+uint32_t HexGrid::changeCount() const
+{
+    return changes;
+}
+
+int HexGrid::distance(const HexNode* a, const HexNode* b)
+{
+    int dq = a->q - b->q;
+    int dr = a->r - b->r;
+    return (std::abs(dq) + std::abs(dr) + std::abs(dq + dr)) / 2;
+}
+
+int HexGrid::firstCellInHex(const HexNode* n) const
+{
+    return cells.FirstInHex(n->q, n->r);
+}
+
+int HexGrid::nearestCell(double x, double y, double radius) const
+{
+    int best = -1;
+    double bestDist2 = radius * radius;
+    for (int cx = int(std::ceil(x - radius)); cx <= int(std::floor(x + radius)); ++cx)
+    {
+        for (int cy = int(std::ceil(y - radius)); cy <= int(std::floor(y + radius)); ++cy)
+        {
+            const double dx = cx - x, dy = cy - y;
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 >= bestDist2)
+                continue;
+            const int id = cells.Find(CellPos{ cx, cy });
+            if (id < 0)
+                continue;
+            best = id;
+            bestDist2 = dist2;
+        }
+    }
+    return best;
+}
+
+int HexGrid::hexesContaining(const CellPos& p, int (&hq)[7], int (&hr)[7])
+{
+    // nearest hex center, then its ring: a border cell belongs to both sides
+    int q, r;
+    HexGeometry::nearestHex(p.x, p.y, q, r);
+
+    int count = 0;
+    for (int i = -1; i < 6; ++i)
+    {
+        int cq = q + (i < 0 ? 0 : hexDq[i]);
+        int cr = r + (i < 0 ? 0 : hexDr[i]);
+        if (HexGeometry::insideHex(cq, cr, p)) {
+            hq[count] = cq;
+            hr[count] = cr;
+            ++count;
+        }
+    }
+    return count;
+}
+
+int HexGrid::addCell(const CellPos& p)
+{
+    bool created;
+    return cells.Add(p, created);
+}
+
+GenRecord& HexGrid::addRecord(const HexNode* n)
+{
+    GenRecord& rec = records.GetOrInsert(n->q, n->r);
+    rec = GenRecord();
+    return rec;
+}
+
+GenRecord* HexGrid::record(const HexNode* n)
+{
+    return records.Find(n->q, n->r);
+}
+
+bool HexGrid::isResident(const HexNode* n)
+{
+    const GenRecord* rec = record(n);
+    return !rec || rec->resident;
+}
+
+void HexGrid::markResident(HexNode* n)
+{
+    GenRecord* rec = record(n);
+    if (!rec)
+        return;
+    rec->resident = true;
+    listAdd(resident, residentSlot, n->id);
+}
+
+bool HexGrid::keptByOtherHex(const CellPos& p, const HexNode* n)
+{
+    int hq[7], hr[7];
+    int count = hexesContaining(p, hq, hr);
+    for (int i = 0; i < count; ++i)
+    {
+        if (hq[i] == n->q && hr[i] == n->r)
+            continue;
+        HexNode* other = find(hq[i], hr[i]);
+        if (!other || isResident(other))
+            return true;
+    }
+    return false;
+}
+
+void HexGrid::evict(HexNode* n)
+{
+    GenRecord* rec = record(n);
+    if (n->state != HexState::Generated || !rec || !rec->resident)
+        return;
+    rec->resident = false;
+    listRemove(resident, residentSlot, n->id);
+
+    markChanged(n);
+
+    // Neighbours keep their corridor bit towards a dropped cell, so the
+    // link comes back when the cell is created again.
+    ArraySequence<int> dropped;
+    cellsInHex(n, [&](int id) {
+        if (!keptByOtherHex(cells.Pos(id), n))
+            dropped.Append(id);
+    });
+    for (int id : dropped)
+        cells.Remove(id);
+}
+
+int HexGrid::evictFarFrom(const HexNode* center, int radius)
+{
+    int count = 0;
+    // backwards: evict swaps an entry already looked at into place i
+    for (int i = resident.GetLength() - 1; i >= 0; --i)
+    {
+        HexNode* n = node(resident[i]);
+        if (distance(n, center) <= radius || !record(n))
+            continue;
+        evict(n);
+        ++count;
     }
+    return count;
 }
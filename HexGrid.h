@@ -1,39 +1,107 @@
 #pragma once
 #include "ArraySequence.h"
+#include "CellStore.h"
+#include "ChunkedArray.h"
+#include "HexMap.h"
 #include "HexNode.h"
-#include "LazySequence.h"
+
+// Inputs HexGenerator::generate saw for a hex. Replaying them rebuilds the
+// same maze after the hex's cells were evicted.
+struct GenRecord
+{
+    CellPos start;
+    std::array<CellPos, 3> apples = { NoCell, NoCell, NoCell };
+    PendingApples pending = { NoCell, NoCell, NoCell };
+    ArraySequence<CellPos> inbound;  // cells already inside the hex
+    uint8_t generatedMask = 0;      // neighbours generated before it
+    bool connectOnly = false;
+    // a corridor from outside already led into start, so the hex is
+    // joined whatever its walk does
+    bool entered = false;
+    // join every inbound cell to the hex, not just those the walk meets
+    bool linkInbound = false;
+    bool resident = true;
+};
 
 class HexGrid
 {
 public:
-    HexGrid();
+    explicit HexGrid(uint64_t seed = 0);
+    uint64_t worldSeed() const;
     HexNode* root();
-    const LazySequence<HexNode*>& all() const;
+    const ChunkedArray<HexNode>& all() const;
+    HexNode* find(int q, int r);
+    HexNode* getOrCreate(int q, int r);
+    HexNode* node(HexId id);
+    HexNode* neighbor(const HexNode* n, int side);
+    PendingApples& pendingApples(const HexNode* n);
     void ensureNeighbors(HexNode* n);
-    ArraySequence<MazeCell> maze;
 
-    std::unordered_map<uint64_t, int> index;
-    int addCell(const QPointF& p, float step)
+    // Every state change to Generated goes through here, so the frontier
+    // of Linked hexes stays current.
+    void markGenerated(HexNode* n);
+    // Linked hexes in no particular order; removal swaps the last one in,
+    // so a uniform pick and an update are O(1).
+    int frontierSize() const;
+    HexNode* frontierHex(int i);
+
+    // Generating or evicting n rewrites edges of its cells and of the
+    // border and exit cells in its neighbours: bumps all their revisions.
+    void markChanged(HexNode* n);
+    // bumped by every markChanged; equal counts mean no cell changed
+    uint32_t changeCount() const;
+
+    // Calls visit(id) for every cell lying inside or on the border of the
+    // hex; see CellStore::ForEachInHex for the order.
+    template <class F>
+    void cellsInHex(const HexNode* n, F&& visit) const
     {
-        uint64_t k = cellKey(p, step);
-        auto it = index.find(k);
-        if (it != index.end())
-            return it->second;
-
-        MazeCell c;
-        c.pos = p;
-
-        int id = int(maze.GetLength());
-        maze.Append(c);
-        index[k] = id;
-        return id;
+        cells.ForEachInHex(n->q, n->r, visit);
     }
+    // -1 when the hex holds no cell
+    int firstCellInHex(const HexNode* n) const;
+    // Cell nearest to the lattice point (x, y) and closer than radius, or
+    // -1. Probes the lattice points of the radius square only, so the cost
+    // does not grow with the world.
+    int nearestCell(double x, double y, double radius) const;
+
+    GenRecord& addRecord(const HexNode* n);
+    GenRecord* record(const HexNode* n);
+    bool isResident(const HexNode* n);
+    // HexGenerator::regenerate brought the cells of n back
+    void markResident(HexNode* n);
+
+    // Drops the cells of a generated hex; HexGenerator::regenerate brings
+    // them back. Cells shared with a resident hex are kept.
+    void evict(HexNode* n);
+    // Looks only at the generated hexes that still hold cells, so its cost
+    // follows the resident area, not the explored world.
+    int evictFarFrom(const HexNode* center, int radius);
+
+    static int distance(const HexNode* a, const HexNode* b);
+
+    CellStore cells;
+    int addCell(const CellPos& p);
 
 private:
     HexNode* createNode(int q, int r);
-    HexNode* getOrCreate(int q, int r);
+    static int hexesContaining(const CellPos& p, int (&hq)[7], int (&hr)[7]);
+    bool keptByOtherHex(const CellPos& p, const HexNode* n);
+    // HexId lists with O(1) removal: slot holds each id's place, or -1
+    static void listAdd(ArraySequence<HexId>& list, ArraySequence<int>& slot, HexId id);
+    static void listRemove(ArraySequence<HexId>& list, ArraySequence<int>& slot, HexId id);
 
-    HexNode* start = nullptr;
-    LazySequence<HexNode*> nodes;
+    HexId start = NoHex;
+    ChunkedArray<HexNode> nodes;
+    HexMap<HexId> byAxial;
+    HexMap<PendingApples> pending;
+    HexMap<GenRecord> records;
+    uint64_t seed;
+    uint32_t changes = 0;
+    ArraySequence<HexId> frontier;
+    ArraySequence<int> frontierSlot;
+    // generated hexes whose cells are stored
+    ArraySequence<HexId> resident;
+    ArraySequence<int> residentSlot;
 
 };
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include "ChunkedArray.h"
+#include "FlatIndex.h"
+
+// Map keyed by axial hex coordinates (q, r). Values live in a ChunkedArray
+// in insertion order, so they can be iterated linearly and never move.
+template <class T>
+class HexMap {
+public:
+    struct Entry {
+        int q = 0;
+        int r = 0;
+        T value = T();
+    };
+
+    using Iterator = typename ChunkedArray<Entry>::Iterator;
+    using ConstIterator = typename ChunkedArray<Entry>::ConstIterator;
+
+    static uint64_t Key(int q, int r)
+    {
+        return (uint64_t(uint32_t(q)) << 32) | uint32_t(r);
+    }
+
+    T* Find(int q, int r)
+    {
+        const int i = index.Find(Key(q, r));
+        return i < 0 ? nullptr : &entries[i].value;
+    }
+
+    const T* Find(int q, int r) const
+    {
+        const int i = index.Find(Key(q, r));
+        return i < 0 ? nullptr : &entries[i].value;
+    }
+
+    bool Contains(int q, int r) const
+    {
+        return index.Contains(Key(q, r));
+    }
+
+    // Returns the existing value for (q, r) or inserts a default one.
+    T& GetOrInsert(int q, int r)
+    {
+        const int i = index.Find(Key(q, r));
+        if (i >= 0)
+            return entries[i].value;
+
+        index.Insert(Key(q, r), entries.GetLength());
+        Entry& e = entries.Append(Entry());
+        e.q = q;
+        e.r = r;
+        return e.value;
+    }
+
+    T& Insert(int q, int r, const T& value)
+    {
+        T& slot = GetOrInsert(q, r);
+        slot = value;
+        return slot;
+    }
+
+    int GetLength() const { return entries.GetLength(); }
+
+    Entry& GetEntry(int i) { return entries[i]; }
+    const Entry& GetEntry(int i) const { return entries[i]; }
+
+    Iterator begin() { return entries.begin(); }
+    Iterator end()   { return entries.end(); }
+    ConstIterator begin() const { return entries.begin(); }
+    ConstIterator end()   const { return entries.end(); }
+
+    void Clear()
+    {
+        entries.Clear();
+        index.Clear();
+    }
+
+private:
+    ChunkedArray<Entry> entries;
+    FlatIndex index;
+};
@@ -1,26 +1,26 @@
 #pragma once
 #include <array>
-#include <QPainter>
+#include <cstdint>
 #include "ArraySequence.h"
+#include "HexGeometry.h"
 
 enum class HexState {
     Linked,
     Generated
 };
 
-struct MazeCell
+static constexpr uint64_t cellKey(const CellPos& p)
 {
-    QPointF pos;
-    int edge[4] = {-1, -1, -1, -1};  // 0=R,1=L,2=U,3=D
-};
-
-static inline uint64_t cellKey(const QPointF& p, float step)
-{
-    int x = int(std::round(p.x() / step));
-    int y = int(std::round(p.y() / step));
-    return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+    return (uint64_t(uint32_t(p.x)) << 32) | uint32_t(p.y);
 }
 
+// Index of a HexNode in the HexGrid arena.
+using HexId = uint32_t;
+static constexpr HexId NoHex = UINT32_MAX;
+
+// empty slots hold NoCell
+using PendingApples = std::array<CellPos, 3>;
+
 struct HexNode {
     int q = 0;
     int r = 0;
@@ -29,15 +29,19 @@ struct HexNode {
 
     int knownBeforeGen = 0;
 
+    // bumped whenever cells of this hex gain or lose edges
+    uint32_t revision = 0;
+
+    HexId id = NoHex;
+
     // 0 Right
     // 1 Down-Right
     // 2 Down-Left
     // 3 Left
     // 4 Up-Left
     // 5 Up-Right
-    HexNode* neigh[6] = {
-        nullptr, nullptr, nullptr,
-        nullptr, nullptr, nullptr
+    HexId neigh[6] = {
+        NoHex, NoHex, NoHex,
+        NoHex, NoHex, NoHex
     };
-    std::array<QPointF, 3> pending_apple = {QPointF(), QPointF(), QPointF()};
 };
@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <utility>
+
+// Random stream owned by a single hex. It is a pure function of the world
+// seed, the hex coordinates and its entry key, so generating the same hex
+// from the same inputs always yields the same maze. The shuffle is written
+// out here instead of using std::shuffle, whose output depends on the
+// standard library.
+class HexRandom {
+public:
+    HexRandom(uint64_t worldSeed, int q, int r, uint64_t entryKey)
+    {
+        state = Mix(worldSeed);
+        state = Mix(state ^ (uint64_t(uint32_t(q)) << 32 | uint32_t(r)));
+        state = Mix(state ^ entryKey);
+    }
+
+    uint64_t Next()
+    {
+        state += 0x9E3779B97F4A7C15ull;
+        return Mix(state);
+    }
+
+    // Uniform integer in [0, n).
+    int Range(int n)
+    {
+        return int((Next() >> 32) * uint64_t(n) >> 32);
+    }
+
+    // Uniform float in [0, 1).
+    float Unit()
+    {
+        return float(Next() >> 40) * (1.0f / float(1 << 24));
+    }
+
+    template <class T, size_t N>
+    void Shuffle(std::array<T, N>& a)
+    {
+        for (int i = int(N) - 1; i > 0; --i)
+            std::swap(a[i], a[Range(i + 1)]);
+    }
+
+private:
+    static uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t state;
+};
@@ -8,43 +8,20 @@
 #include <cmath>
 #include <algorithm>
 #include <QPushButton>
-#include <queue>
 
 
-static const QPointF dirVec[4] = {
-    {  1,  0 },  // R
-    { -1,  0 },  // L
-    {  0, -1 },  // U
-    {  0,  1 }   // D
-};
-
 const float pi = acos(-1);
-static const QPointF sideNormal[6] = {
-    {  1.0f,  0.0f },
-    {  0.5f,  std::cos(pi/6) },
-    { -0.5f,  std::cos(pi/6) },
-    { -1.0f,  0.0f },
-    { -0.5f, -std::cos(pi/6)},
-    {  0.5f, -std::cos(pi/6) }
-};
-
-
 
-static bool pointInsideHex(const QPointF& p, float hexRadius)
+static bool pointInsideHex(const HexNode* hex, const CellPos& p)
 {
-    const float d = hexRadius * std::cos(pi/6);
-    for (int i = 0; i < 6; ++i)
-        if (QPointF::dotProduct(p, sideNormal[i]) >= d)
-            return false;
-    return true;
+    return HexGeometry::insideHex(hex->q, hex->r, p);
 }
 
 
-bool HexView::crossedSides(const QPointF& p, ArraySequence<int>& side)
+bool HexView::crossedSides(const HexNode* hex, const CellPos& p, ArraySequence<int>& side)
 {
-    const float d = hexRadius * std::cos(pi/6);
     for (int i = 0; i < 6; ++i){
-        if (QPointF::dotProduct(p, sideNormal[i]) >= d){
+        if (!HexGeometry::withinSide(i, hex->q, hex->r, p)){
             side.Append(i);
         }
     }
@@ -52,8 +29,15 @@ bool HexView::crossedSides(const QPointF& p, ArraySequence<int>& side)
 }
 
 
+static uint64_t newWorldSeed()
+{
+    std::random_device rd;
+    return (uint64_t(rd()) << 32) | rd();
+}
+
 HexView::HexView(QWidget* parent)
-    : QWidget(parent)
+    : QWidget(parent), grid(newWorldSeed()), appleRng(uint32_t(grid.worldSeed())),
+      pregen(grid.worldSeed())
 {
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
@@ -63,11 +47,10 @@ HexView::HexView(QWidget* parent)
     setupNavMenu();
     setupNavButton();
 
-    srand(time(NULL));
     cur = grid.root();
 
-    HexGenerator::generate(grid, cur, hexRadius, {0, 0});
-    cursor = grid.maze[grid.addCell({0, 0}, step)];
+    HexGenerator::generate(grid, cur, CellPos{0, 0});
+    cursor = {0, 0};
     score = 0;
     for (int i = 0; i < 3; ++i){
         spawnApple(i);
@@ -76,17 +59,25 @@ HexView::HexView(QWidget* parent)
 
     arrowDir = 0;
     zoom = 1.0f;
-    path.Append( cursor.pos);
+    path.Start(cursor);
+    speculate();
     centerCamera();
 
 }
 
 QPointF HexView::axialToPixel(int q, int r) const
 {
-    return {
-        hexRadius * (2 * cos(pi/6) * q + cos(pi/6) * r),
-        hexRadius * (1.5f * r)
-    };
+    return { HexGeometry::centerX(q, r, hexRadius), HexGeometry::centerY(r, hexRadius) };
+}
+
+QPointF HexView::cellToWorld(const CellPos& c) const
+{
+    return { c.x * step, c.y * step };
+}
+
+CellPos HexView::worldToCell(const QPointF& p) const
+{
+    return { int(std::lround(p.x() / step)), int(std::lround(p.y() / step)) };
 }
 
 QPolygonF HexView::hexPolygonAt(const QPointF& c) const
@@ -106,7 +97,7 @@ QPolygonF HexView::hexPolygonAt(const QPointF& c) const
 
 void HexView::centerCamera()
 {
-    QPointF worldCursor = cursor.pos;
+    QPointF worldCursor = cellToWorld(cursor);
 
     QPointF screenCenter(width() / 2.0f, height() / 2.0f);
     camera = screenCenter - worldCursor * zoom + cameraDragOffset;
@@ -116,38 +107,91 @@ bool HexView::isAppleInHex(HexNode* h) const
 {
     bool has = false;
     for (int i = 0; i < 3; ++i){
-        QPointF hexCenter = axialToPixel(h->q, h->r);
-        QPointF local  = apples[i] - hexCenter;
-        has |= pointInsideHex(local, hexRadius);
+        has |= pointInsideHex(h, apples[i]);
     }
     return has;
 }
 
-void HexView::moveToNeighbor(int side, QPointF delta)
+bool HexView::moveToNeighbor(int side, const CellPos& delta)
 {
-    QPointF entryWorld = cursor.pos;
-    if (cur->neigh[side]->state != HexState::Generated)
+    HexNode* next = grid.neighbor(cur, side);
+    if (!grid.isResident(next))
+    {
+        HexGenerator::regenerate(grid, next);
+    }
+    else if (next->state != HexState::Generated)
     {
-        grid.ensureNeighbors(cur->neigh[side]);
-        if (isAppleInHex(cur->neigh[side])){
-            HexGenerator::generate(
-                grid,
-                cur->neigh[side],
-                hexRadius,
-                entryWorld + delta,
-                apples
-                );
+        grid.ensureNeighbors(next);
+        GenRecord rec = captureFor(next, cursor + delta);
+        GenResult res;
+        if (pregen.take(next->q, next->r, rec, res)){
+            return HexGenerator::commit(grid, next, res);
         }
-        else{
-            HexGenerator::generate(
-                grid,
-                cur->neigh[side],
-                hexRadius,
-                entryWorld + delta
-                );
+        return HexGenerator::generate(grid, next, rec);
+    }
+    return true;
+}
+
+GenRecord HexView::captureFor(HexNode* next, const CellPos& start)
+{
+    if (isAppleInHex(next))
+        return HexGenerator::capture(grid, next, start, apples);
+    return HexGenerator::capture(grid, next, start);
+}
+
+// Queues the hexes behind the exits of cur closest to the cursor. Exits
+// ahead of the arrow count as nearer, so the usual guess is the hex the
+// player is walking towards.
+void HexView::speculate()
+{
+    static const QPointF heading[4] = { {1, 0}, {0, 1}, {-1, 0}, {0, -1} };
+    const CellPos from = cursor;
+
+    struct Exit { float score; int side; CellPos start; };
+    ArraySequence<Exit> exits;
+    grid.cellsInHex(cur, [&](int id){
+        const CellPos pos = grid.cells.Pos(id);
+        for (int d = 0; d < 4; ++d){
+            if (grid.cells.Neighbor(id, d) < 0)
+                continue;
+            CellPos start = pos + HexGeometry::dirStep[d];
+            ArraySequence<int> side;
+            if (!crossedSides(cur, start, side))
+                continue;
+            HexNode* next = grid.neighbor(cur, side[0]);
+            if (next->state == HexState::Generated)
+                continue;
+            QPointF v(pos.x - from.x, pos.y - from.y);
+            float dist = std::sqrt(QPointF::dotProduct(v, v));
+            float score = dist - 0.5f * QPointF::dotProduct(v, heading[arrowDir]);
+            exits.Append({score, side[0], start});
         }
+    });
+    std::sort(exits.begin(), exits.end(),
+              [](const Exit& a, const Exit& b) { return a.score < b.score; });
+
+    ArraySequence<GenJob> jobs;
+    for (int i = 0; i < exits.GetLength() && jobs.GetLength() < SPECULATE_EXITS; ++i){
+        bool queued = false;
+        for (const GenJob& job : jobs)
+            queued |= job.rec.start == exits[i].start;
+        if (queued)
+            continue;
+        HexNode* next = grid.neighbor(cur, exits[i].side);
+        grid.ensureNeighbors(next);
+        jobs.Append({next->q, next->r, captureFor(next, exits[i].start)});
+    }
+    pregen.request(jobs);
+}
 
+void HexView::restoreAround(HexNode* h)
+{
+    grid.ensureNeighbors(h);
+    HexGenerator::regenerate(grid, h);
+    for (int i = 0; i < 6; ++i){
+        HexGenerator::regenerate(grid, grid.neighbor(h, i));
     }
+    grid.evictFarFrom(h, EVICT_RADIUS);
 }
 
 static int oppositeDir(int d)
@@ -160,43 +204,52 @@ void HexView::keyPressEvent(QKeyEvent* e)
 {
 
     int dir = -1;
-    QPointF delta;
 
-    if (e->key() == Qt::Key_Right)      { dir = 0; delta = { step, 0 }; arrowDir = 0; }
-    else if (e->key() == Qt::Key_Left)  { dir = 1; delta = { -step, 0 }; arrowDir = 2; }
-    else if (e->key() == Qt::Key_Up)    { dir = 2; delta = { 0, -step }; arrowDir = 3; }
-    else if (e->key() == Qt::Key_Down)  { dir = 3; delta = { 0, step }; arrowDir = 1; }
+    if (e->key() == Qt::Key_Right)      { dir = 0; arrowDir = 0; }
+    else if (e->key() == Qt::Key_Left)  { dir = 1; arrowDir = 2; }
+    else if (e->key() == Qt::Key_Up)    { dir = 2; arrowDir = 3; }
+    else if (e->key() == Qt::Key_Down)  { dir = 3; arrowDir = 1; }
     else return;
+    const CellPos delta = HexGeometry::dirStep[dir];
     cameraDragOffset = {0, 0};
 
-    if (cursor.edge[dir] == -1){
+    int at = grid.cells.Find(cursor);
+    if (at < 0 || grid.cells.Neighbor(at, dir) < 0){
         return;
     }
 
-    QPointF next = cursor.pos + delta;
-    QPointF hexCenter = axialToPixel(cur->q, cur->r);
     ArraySequence<int> side;
-    if (crossedSides(next - hexCenter, side))
+    bool crossed = crossedSides(cur, cursor + delta, side);
+    if (crossed)
     {
 
-        moveToNeighbor(side[0], delta);
+        bool joined = moveToNeighbor(side[0], delta);
         if (side.GetLength() != 1){
-            moveToNeighbor(side[1], delta);
+            joined &= moveToNeighbor(side[1], delta);
+        }
+        // the corridor ahead leads into a hex that is not part of the maze
+        if (!joined){
+            update();
+            return;
         }
-        cur = cur->neigh[side[0]];
+        cur = grid.neighbor(cur, side[0]);
     }
 
-    cursor = grid.maze[cursor.edge[dir]];
+    cursor = cursor + delta;
+    if (crossed){
+        restoreAround(cur);
+    }
+    speculate();
 
     for (int i = 0; i < 3; ++i){
-        if (cursor.pos == apples[i])
+        if (cursor == apples[i])
         {
             score++;
             spawnApple(i);
         }
     }
 
-    path.Append(cursor.pos);
+    path.Step(dir);
 
     centerCamera();
     update();
@@ -209,7 +262,7 @@ void HexView::wheelEvent(QWheelEvent* e)
         (QPointF(width()/2, height()/2) - camera) / zoom;
 
     zoom *= (e->angleDelta().y() > 0) ? 1.1f : 0.9f;
-    zoom = std::clamp(zoom, 0.4f, 4.0f);
+    zoom = std::clamp(zoom, MIN_ZOOM, 4.0f);
 
     camera = QPointF(width()/2, height()/2) - worldCenter * zoom;
     update();
@@ -237,28 +290,17 @@ void HexView::mouseDoubleClickEvent(QMouseEvent* e)
 {
     QPointF worldClick = (e->pos() - camera) / zoom;
 
-    const float MAX_DIST2 = step * step;
-    int best = -1;
-    float bestDist2 = MAX_DIST2;
-
-    for (int ind = 0; ind < grid.maze.GetLength();++ind) {
-        QPointF d = grid.maze[ind].pos - worldClick;
-        float dist2 = d.x()*d.x() + d.y()*d.y();
-        if (dist2 < bestDist2) {
-            bestDist2 = dist2;
-            best = ind;
-        }
-    }
-
+    // nearest cell no more than one lattice step away
+    const int best = grid.nearestCell(worldClick.x() / step, worldClick.y() / step, 1.0);
 
     if (best == -1) {
-        goal = QPointF();
+        goal = NoCell;
         update();
         return;
     }
 
 
-    goal = grid.maze[best].pos;
+    goal = grid.cells.Pos(best);
     update();
 }
 
@@ -268,52 +310,40 @@ void HexView::mouseReleaseEvent(QMouseEvent*)
     dragging = false;
 }
 
-QPointF HexView::randomPointInHex(const QPointF& hexCenter)
+CellPos HexView::randomPointInHex(const HexNode* hex)
 {
-
-    QPointF center;
-    center.setX(std::round(hexCenter.x() / step) * step);
-    center.setY(std::round(hexCenter.y() / step) * step);
+    const CellPos center = {
+        int(std::lround(HexGeometry::centerX(hex->q, hex->r, HexGeometry::LatticeRadius))),
+        int(std::lround(HexGeometry::centerY(hex->r, HexGeometry::LatticeRadius)))
+    };
 
     while (true)
     {
-        float angle = float(rand()) / RAND_MAX * 2.0f * pi;
-        float dist  = std::sqrt(float(rand()) / RAND_MAX) * hexRadius;
+        float angle = random01() * 2.0f * pi;
+        float dist  = std::sqrt(random01()) * HexGeometry::LatticeRadius;
 
-        QPointF offset(
-            std::cos(angle) * dist,
-            std::sin(angle) * dist
-            );
-
-        QPointF world = center + offset;
-
-        if (!pointInsideHex(world - hexCenter, hexRadius))
-            continue;
-
-        world.setX(std::round(world.x() / step) * step);
-        world.setY(std::round(world.y() / step) * step);
+        CellPos cell = {
+            center.x + int(std::lround(std::cos(angle) * dist)),
+            center.y + int(std::lround(std::sin(angle) * dist))
+        };
 
-        return world;
+        if (pointInsideHex(hex, cell))
+            return cell;
     }
 }
 
 
 
-void HexView::spawnApple(int i)
+float HexView::random01()
 {
-    ArraySequence<HexNode*> candidates;
-    int N = grid.all().GetMaterializedCount();
-    for (int i = 0; i < N; ++i) {
-        HexNode* n = grid.all().Get(i);
-        if (n->state != HexState::Generated){
-            candidates.Append(n);
-        }
-    }
+    return std::uniform_real_distribution<float>(0.0f, 1.0f)(appleRng);
+}
 
-    HexNode* hex = candidates[rand() % candidates.GetLength()];
+void HexView::spawnApple(int i)
+{
+    const HexNode* hex = grid.frontierHex(int(appleRng() % grid.frontierSize()));
 
-    QPointF hexCenter = axialToPixel(hex->q, hex->r);
-    apples[i] = randomPointInHex(hexCenter);
+    apples[i] = randomPointInHex(hex);
 }
 
 
@@ -326,7 +356,7 @@ void HexView::spawnApple(int i)
 void HexView::drawApple(QPainter& p)
 {
     for (int i = 0; i < 3; ++i){
-        QPointF screen = apples[i] * zoom + camera;
+        QPointF screen = cellToWorld(apples[i]) * zoom + camera;
 
         p.setPen(Qt::NoPen);
         p.setBrush(QColor(220, 40, 40));
@@ -342,14 +372,14 @@ void HexView::drawApple(QPainter& p)
 
 bool HexView::isAppleOnScreen(int i) const
 {
-    QPointF s = apples[i] * zoom + camera;
+    QPointF s = cellToWorld(apples[i]) * zoom + camera;
     return rect().contains(s.toPoint());
 }
 
 void HexView::drawApplePointer(QPainter& p, int i)
 {
     QPointF center(width()/2.0, height()/2.0);
-    QPointF target = apples[i] * zoom + camera;
+    QPointF target = cellToWorld(apples[i]) * zoom + camera;
 
     QPointF v = target - center;
     double len = std::hypot(v.x(), v.y());
@@ -378,92 +408,59 @@ void HexView::drawApplePointer(QPainter& p, int i)
 
 HexNode* HexView::hexAtAxial(int q, int r)
 {
-    int N = grid.all().GetMaterializedCount();
-    for (int i = 0; i < N; ++i) {
-        HexNode* n = grid.all().Get(i);
-        if (n->q == q && n->r == r)
-            return n;
-    }
-    return nullptr;
+    return grid.find(q, r);
 }
 
 
 
-QPointF HexView::pixelToAxial(const QPointF& p) const
+HexNode* HexView::hexAtCell(const CellPos& c)
 {
-    float q = (sqrt(3.f)/3.f * p.x() - 1.f/3.f * p.y()) / hexRadius;
-    float r = (2.f/3.f * p.y()) / hexRadius;
-    return { q, r };
-}
-
-
-HexNode* HexView::hexAtWorld(const QPointF& world)
-{
-    QPointF a = pixelToAxial(world);
-
-    float x = a.x();
-    float z = a.y();
-    float y = -x - z;
-
-    int rx = round(x);
-    int ry = round(y);
-    int rz = round(z);
-
-    float dx = abs(rx - x);
-    float dy = abs(ry - y);
-    float dz = abs(rz - z);
-
-    if (dx > dy && dx > dz)
-        rx = -ry - rz;
-    else if (dy > dz)
-        ry = -rx - rz;
-    else
-        rz = -rx - ry;
-
-    return hexAtAxial(rx, rz);
+    int q, r;
+    HexGeometry::nearestHex(c.x, c.y, q, r);
+    return hexAtAxial(q, r);
 }
 
 
 
 void HexView::tryTeleportToPath(const QPointF& screenPos)
 {
-    const float MAX_DIST2 = (step * 0.6f) * (step * 0.6f);
-
     QPointF worldClick = (screenPos - camera) / zoom;
 
-    int best = -1;
-    float bestDist2 = MAX_DIST2;
-
-    for (size_t i = 0; i < path.GetLength(); ++i)
+    // visited path points lie on lattice points: probe the neighbouring ones
+    const double x = worldClick.x() / step, y = worldClick.y() / step;
+    const double radius = 0.6;
+    CellPos target = NoCell;
+    double bestDist2 = radius * radius;
+    for (int cx = int(std::ceil(x - radius)); cx <= int(std::floor(x + radius)); ++cx)
     {
-        QPointF d = worldClick - path[i];
-        float dist2 = d.x()*d.x() + d.y()*d.y();
-        if (dist2 < bestDist2)
+        for (int cy = int(std::ceil(y - radius)); cy <= int(std::floor(y + radius)); ++cy)
         {
-            bestDist2 = dist2;
-            best = int(i);
+            const double dx = cx - x, dy = cy - y;
+            if (dx * dx + dy * dy < bestDist2 && path.Visited({ cx, cy }))
+            {
+                bestDist2 = dx * dx + dy * dy;
+                target = { cx, cy };
+            }
         }
     }
 
-    if (best == -1)
+    if (target == NoCell)
         return;
 
-    QPointF targetWorld = path[best];
-
-    HexNode* targetHex = hexAtWorld(targetWorld);
+    HexNode* targetHex = hexAtCell(target);
     if (!targetHex || targetHex->state != HexState::Generated)
         return;
 
     cur = targetHex;
-
-    QPointF hexCenter = axialToPixel(cur->q, cur->r);
-    cursor = grid.maze[grid.addCell(targetWorld, step)];
+    cursor = target;
+    restoreAround(cur);
+    pregen.clear();
+    speculate();
 
     arrowDir = 0;
 
     cameraDragOffset = {0, 0};
-    path.Append({step/2, step/2});
-    path.Append(cursor.pos);
+    path.Start(cursor);
     centerCamera();
     update();
 }
@@ -478,10 +475,32 @@ void HexView::mousePressEvent(QMouseEvent* e)
         lastMouse = e->pos();
     }
 }
+
+// Pointy-top hexes: a hex can touch the widget only if its center lies
+// within half a hex width (horizontally) or one radius (vertically) of
+// the visible world rectangle. Hexes never created have nothing to draw.
+void HexView::collectVisibleHexes()
+{
+    visibleHexes.Clear();
+    // a cell of margin: a corridor is drawn by one of the hexes it touches
+    QPointF topLeft = -camera / zoom - QPointF(step, step);
+    QPointF bottomRight = (QPointF(width(), height()) - camera) / zoom + QPointF(step, step);
+    const float w = 2 * hexRadius * cos(pi/6);
+
+    int r0 = int(std::floor((topLeft.y() - hexRadius) / (1.5f * hexRadius)));
+    int r1 = int(std::ceil((bottomRight.y() + hexRadius) / (1.5f * hexRadius)));
+    for (int r = r0; r <= r1; ++r){
+        int q0 = int(std::floor((topLeft.x() - w / 2) / w - r / 2.0f));
+        int q1 = int(std::ceil((bottomRight.x() + w / 2) / w - r / 2.0f));
+        for (int q = q0; q <= q1; ++q){
+            if (HexNode* n = grid.find(q, r))
+                visibleHexes.Append(n);
+        }
+    }
+}
+
 void HexView::drawGeneratedHex(QPainter& p){
-    int N = grid.all().GetMaterializedCount();
-    for (int i = 0; i < N; ++i) {
-        HexNode* n = grid.all().Get(i);
+    for (HexNode* n : visibleHexes) {
         QPointF hexWorld = axialToPixel(n->q, n->r);
         QPointF c = hexWorld * zoom + camera;
 
@@ -496,50 +515,175 @@ void HexView::drawGeneratedHex(QPainter& p){
     }
 
 }
-void HexView::drawMaze(QPainter& p){
 
+// Edges are symmetric, so each corridor segment is emitted once from the
+// cell on its left or top end. A link whose other end was evicted has no
+// partner to emit it and is drawn from this side.
+void HexView::collectTileLines(HexNode* n, QVector<QLineF>& lines)
+{
+    lines.clear();
+    grid.cellsInHex(n, [&](int id)
+    {
+        const uint8_t edges = grid.cells.Edges(id);
+        QPointF pos = cellToWorld(grid.cells.Pos(id));
+
+        if (edges & 1)
+            lines.append(QLineF(pos, pos + QPointF(step, 0)));
+        if (edges & 8)
+            lines.append(QLineF(pos, pos + QPointF(0, step)));
+        if ((edges & 2) && grid.cells.Neighbor(id, 1) < 0)
+            lines.append(QLineF(pos, pos - QPointF(step, 0)));
+        if ((edges & 4) && grid.cells.Neighbor(id, 2) < 0)
+            lines.append(QLineF(pos, pos - QPointF(0, step)));
+    });
+}
+
+// An evicted hex holds no cells: its corridors come from replaying its
+// GenRecord in a private grid. Lines follow the rules of collectTileLines.
+void HexView::collectRecordLines(HexNode* n, QVector<QLineF>& lines)
+{
+    lines.clear();
+    GenResult res;
+    HexGenerator::generateDetached(n->q, n->r, *grid.record(n), grid.worldSeed(), res);
+    for (const GenCell& c : res.cells){
+        if (!pointInsideHex(n, c.pos))
+            continue;
+        QPointF pos = cellToWorld(c.pos);
+
+        if (c.edges & 1)
+            lines.append(QLineF(pos, pos + QPointF(step, 0)));
+        if (c.edges & 8)
+            lines.append(QLineF(pos, pos + QPointF(0, step)));
+        if ((c.edges & 2) && !pointInsideHex(n, c.pos + HexGeometry::dirStep[1]))
+            lines.append(QLineF(pos, pos - QPointF(step, 0)));
+        if ((c.edges & 4) && !pointInsideHex(n, c.pos + HexGeometry::dirStep[2]))
+            lines.append(QLineF(pos, pos - QPointF(0, step)));
+    }
+}
+
+void HexView::recordTile(QPicture& pic, const QVector<QLineF>& lines, const QPen& pen)
+{
+    pic = QPicture();
+    QPainter p(&pic);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.setPen(pen);
+    p.drawLines(lines);
+    p.end();
+}
 
-    float roadOuter = step * 0.70f;
-    float roadInner = step * 0.50f;
+// The hex plus a cell on every side for corridors leading out of it.
+QRectF HexView::tileWorldRect(HexNode* n) const
+{
+    QPointF c = axialToPixel(n->q, n->r);
+    float hw = hexRadius * cos(pi/6) + step;
+    float hh = hexRadius + step;
+    return QRectF(c.x() - hw, c.y() - hh, 2 * hw, 2 * hh);
+}
 
+QImage HexView::rasterTile(HexNode* n, const QVector<QLineF>& lines) const
+{
+    QRectF box = tileWorldRect(n);
+    QImage img(int(std::ceil(box.width() * LOD_SCALE)),
+               int(std::ceil(box.height() * LOD_SCALE)),
+               QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::transparent);
 
-    p.setPen(QPen(Qt::black, roadOuter * zoom));
+    QPainter p(&img);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.scale(LOD_SCALE, LOD_SCALE);
+    p.translate(-box.left(), -box.top());
+    p.setPen(QPen(Qt::black, roadOuter));
+    p.drawLines(lines);
+    p.setPen(QPen(QColor(245, 222, 179), roadInner));
+    p.drawLines(lines);
+    p.end();
+    return img;
+}
 
-    for (auto& c: grid.maze)
-    {
-        QPointF p0 = c.pos * zoom + camera;
+// Rebuilt only when the hex revision moved, i.e. after its own or a
+// neighbour's generation or eviction.
+HexTile& HexView::tileFor(HexNode* n, bool lowRes)
+{
+    HexTile& t = tiles.GetOrInsert(n->q, n->r);
+    if (!t.valid || t.revision != n->revision){
+        t.revision = n->revision;
+        t.valid = true;
+        t.recorded = false;
+        t.lowRes = QImage();
+    }
+    if (lowRes ? !t.lowRes.isNull() : t.recorded)
+        return t;
 
-        if (c.edge[0]!= -1)
-            p.drawLine(p0, (c.pos + QPointF(step, 0)) * zoom + camera);
-        if (c.edge[1]!= -1)
-            p.drawLine(p0, (c.pos - QPointF(step, 0)) * zoom + camera);
-        if (c.edge[2]!= -1)
-            p.drawLine(p0, (c.pos - QPointF(0, step)) * zoom + camera);
-        if (c.edge[3]!= -1)
-            p.drawLine(p0, (c.pos + QPointF(0, step)) * zoom + camera);
+    if (grid.isResident(n))
+        collectTileLines(n, tileLines);
+    else
+        collectRecordLines(n, tileLines);
+    if (lowRes){
+        t.lowRes = rasterTile(n, tileLines);
+    }
+    else{
+        recordTile(t.outer, tileLines, QPen(Qt::black, roadOuter));
+        recordTile(t.inner, tileLines, QPen(QColor(245, 222, 179), roadInner));
+        t.recorded = true;
     }
+    return t;
+}
 
-    p.setPen(QPen(QColor(245, 222, 179), roadInner * zoom));
-    for (auto& c : grid.maze)
-    {
-        QPointF p0 = c.pos * zoom + camera;
+void HexView::drawMaze(QPainter& p){
+    if (tiles.GetLength() > MAX_TILES + visibleHexes.GetLength())
+        tiles.Clear();
+
+    // An evicted hex is drawn from its raster at any zoom. Rebuilding one
+    // replays its generation, so a frame rebuilds a few and asks for
+    // another frame for the rest.
+    const bool lowRes = zoom < LOD_ZOOM;
+    int replays = 0;
+    ArraySequence<HexNode*> blitted;
+    ArraySequence<HexTile*> rasters;
+    ArraySequence<HexTile*> visible;
+    for (HexNode* n : visibleHexes){
+        if (!grid.isResident(n)){
+            const HexTile* t = tiles.Find(n->q, n->r);
+            bool built = t && t->valid && t->revision == n->revision && !t->lowRes.isNull();
+            if (!built && replays++ >= REPLAYS_PER_FRAME)
+                continue;
+            blitted.Append(n);
+            rasters.Append(&tileFor(n, true));
+        }
+        else if (grid.firstCellInHex(n) >= 0){
+            HexTile& t = tileFor(n, lowRes);
+            if (lowRes){
+                blitted.Append(n);
+                rasters.Append(&t);
+            }
+            else
+                visible.Append(&t);
+        }
+    }
+    if (replays > REPLAYS_PER_FRAME)
+        update();
 
-        if (c.edge[0] != -1)
-            p.drawLine(p0, (c.pos + QPointF(step, 0)) * zoom + camera);
-        if (c.edge[1]!= -1)
-            p.drawLine(p0, (c.pos - QPointF(step, 0)) * zoom + camera);
-        if (c.edge[2]!= -1)
-            p.drawLine(p0, (c.pos - QPointF(0, step)) * zoom + camera);
-        if (c.edge[3]!= -1)
-            p.drawLine(p0, (c.pos + QPointF(0, step)) * zoom + camera);
+    for (int i = 0; i < blitted.GetLength(); ++i){
+        QRectF box = tileWorldRect(blitted[i]);
+        QRectF target(box.left() * zoom + camera.x(), box.top() * zoom + camera.y(),
+                      box.width() * zoom, box.height() * zoom);
+        p.drawImage(target, rasters[i]->lowRes);
     }
+    if (lowRes)
+        return;
 
+    p.save();
+    p.translate(camera);
+    p.scale(zoom, zoom);
+    for (HexTile* t : visible)
+        p.drawPicture(0, 0, t->outer);
+    for (HexTile* t : visible)
+        p.drawPicture(0, 0, t->inner);
+    p.restore();
 }
 
 void HexView::drawBlackHex(QPainter& p){
-    int N = grid.all().GetMaterializedCount();
-    for (int i = 0; i < N; ++i) {
-        HexNode* n = grid.all().Get(i);
+    for (HexNode* n : visibleHexes) {
         QPointF hexWorld = axialToPixel(n->q, n->r);
         QPointF c = hexWorld * zoom + camera;
 
@@ -554,53 +698,83 @@ void HexView::drawBlackHex(QPainter& p){
 }
 
 void HexView::drawBFS(QPainter& p){
-    if (bfsPath.GetLength() > 1)
+    if (bfsPath.elementCount() > 1)
     {
-        QPen pen(QColor(255, 100, 100));
-        pen.setWidthF(2.0 * zoom);
-        p.setPen(pen);
+        p.save();
+        p.translate(camera);
+        p.scale(zoom, zoom);
+        p.setPen(QPen(QColor(255, 100, 100), 2.0));
         p.setBrush(Qt::NoBrush);
-        QPainterPath pp;
-        pp.moveTo(bfsPath[0] * zoom + camera);
-        for (size_t i = 1; i < bfsPath.GetLength(); ++i)
-            pp.lineTo(bfsPath[i] * zoom + camera);
-        p.drawPath(pp);
+        p.drawPath(bfsPath);
+        p.restore();
     }
 }
 
-void HexView::drawPathCursor(QPainter& p){
-    QPointF zero = {step/2, step/2};
-    QPen pen(QColor(50, 200, 255));
-    pen.setWidthF(2.0 * zoom);
-    p.setPen(pen);
-    p.setBrush(Qt::NoBrush);
+// Appends the hex's new pieces and the grown last run to the tile; the
+// rest is already in world.
+PathTile& HexView::pathTileFor(const HexNode* n)
+{
+    PathTile& t = pathTiles.GetOrInsert(n->q, n->r);
+    const ArraySequence<int>* pieces = path.PiecesIn(n->q, n->r);
+    if (!pieces)
+        return t;
 
-    QPainterPath pp;
-    QPointF first = path[0] * zoom + camera;
-    pp.moveTo(first);
-    bool go = true;
-    for (size_t i = 1; i < path.GetLength(); ++i)
+    if (t.pieces > 0)
     {
-        QPointF pt = path[i] * zoom + camera;
-
-        if (pt == zero * zoom + camera){
-            go = false;
-            continue;
+        const int piece = (*pieces)[t.pieces - 1];
+        const int count = path.GetPiece(piece).count;
+        if (t.runs > 0)
+        {
+            const QPointF end = cellToWorld(t.runStart + path.RunOffset(piece, t.runs - 1));
+            t.world.setElementPositionAt(t.world.elementCount() - 1, end.x(), end.y());
         }
-        if (!go){
-            pp.moveTo(pt);
-            go = true;
-            continue;
+        for (; t.runs < count; ++t.runs)
+        {
+            if (t.runs > 0)
+                t.runStart = t.runStart + path.RunOffset(piece, t.runs - 1);
+            t.world.lineTo(cellToWorld(t.runStart + path.RunOffset(piece, t.runs)));
+        }
+    }
+
+    for (; t.pieces < pieces->GetLength(); ++t.pieces)
+    {
+        const int piece = (*pieces)[t.pieces];
+        t.runStart = path.GetPiece(piece).start;
+        t.world.moveTo(cellToWorld(t.runStart));
+        t.runs = path.GetPiece(piece).count;
+        CellPos at = t.runStart;
+        for (int k = 0; k < t.runs; ++k)
+        {
+            t.runStart = at;
+            at = at + path.RunOffset(piece, k);
+            t.world.lineTo(cellToWorld(at));
         }
-        pp.lineTo(pt);
     }
+    return t;
+}
 
-    p.drawPath(pp);
+void HexView::drawPathCursor(QPainter& p){
+    if (pathTiles.GetLength() > MAX_TILES + visibleHexes.GetLength())
+        pathTiles.Clear();
+
+    // each path piece lies in one hex: draw only the visible ones
+    p.save();
+    p.translate(camera);
+    p.scale(zoom, zoom);
+    p.setPen(QPen(QColor(50, 200, 255), 2.0));
+    p.setBrush(Qt::NoBrush);
+    for (HexNode* n : visibleHexes)
+    {
+        const PathTile& t = pathTileFor(n);
+        if (!t.world.isEmpty())
+            p.drawPath(t.world);
+    }
+    p.restore();
 }
 
 void HexView::drawCursor(QPainter& p){
     QPointF center =
-        cursor.pos * zoom +
+        cellToWorld(cursor) * zoom +
         camera;
 
     QPointF dir;
@@ -706,7 +880,7 @@ void HexView::drawMessange(QPainter& p){
 }
 
 void HexView::drawGoal(QPainter& p) {
-    if (goal.isNull()) return;
+    if (goal == NoCell) return;
 
     float worldSize = step * 0.2f;
     float size = worldSize * zoom;
@@ -715,7 +889,7 @@ void HexView::drawGoal(QPainter& p) {
     p.setPen(pen);
     p.setBrush(Qt::NoBrush);
 
-    QPointF screenGoal = goal * zoom + camera;
+    QPointF screenGoal = cellToWorld(goal) * zoom + camera;
 
     p.drawLine(screenGoal.x() - size, screenGoal.y() - size,
                screenGoal.x() + size, screenGoal.y() + size);
@@ -733,7 +907,7 @@ void HexView::paintEvent(QPaintEvent*)
     QPainter p(this);
     p.setRenderHint(QPainter::Antialiasing);
     p.fillRect(rect(), QColor(30, 30, 30));
-
+    collectVisibleHexes();
 
     // гексы
     drawGeneratedHex(p);
@@ -769,29 +943,6 @@ void HexView::paintEvent(QPaintEvent*)
 }
 
 
-int targetSide = -1;
-
-bool HexView::isExitToNeighbor(int cellId)
-{
-    MazeCell c = grid.maze[cellId];
-
-    QPointF np = c.pos;
-
-    if (!pointInsideHex(np - axialToPixel(cur->q, cur->r), hexRadius))
-    {
-        QPointF local = np - axialToPixel(cur->q, cur->r);
-
-        ArraySequence<int> side;
-        if (crossedSides(local, side))
-        {
-            if (side[0] == targetSide ||(side.GetLength()!=1 &&  side[1] == targetSide))
-                return true;
-        }
-    }
-    return false;
-}
-
-
 void HexView::setupNavButton()
 {
     navButton = new QPushButton("Навигация", this);
@@ -805,69 +956,61 @@ void HexView::setupNavButton()
 }
 
 
-ArraySequence<QPointF> HexView::bfsInHex(
-    HexGrid& grid,
-    HexNode* hex,
-    int startId,
-    std::function<bool(int)> isTarget,
-    float hexRadius,
-    bool apple
-    )
+// Distances to the sides of the hex, rebuilt when its revision moves.
+const ExitTable& HexView::exitTableFor(HexNode* n)
 {
-    std::queue<int> q;
-    std::unordered_map<int, int> parent;
-    q.push(startId);
-    parent[startId] = -1;
-
-    while (!q.empty())
-    {
-        int v = q.front(); q.pop();
+    if (!exitTables.Contains(n->q, n->r) && exitTables.GetLength() >= MAX_EXIT_TABLES)
+        exitTables.Clear();
+    ExitTable& t = exitTables.GetOrInsert(n->q, n->r);
+    if (!t.IsCurrent(n))
+        t.Build(grid, n);
+    return t;
+}
 
-        if (isTarget(v))
-        {
-            ArraySequence<QPointF> side;
-            for (int cur = v; cur != -1; cur = parent[cur])
-                side.Append(grid.maze[cur].pos);
-            return side;
-        }
+// All navigation menu answers from one search, while the cursor and the
+// world stay the same.
+void HexView::refreshNav()
+{
+    if (nav.valid && nav.cursor == cursor && nav.gridChanges == grid.changeCount() &&
+        nav.apples == apples && nav.goal == goal)
+        return;
 
-        if (!apple && !pointInsideHex(grid.maze[v].pos - axialToPixel(cur->q, cur->r), hexRadius)){
-            continue;
-        }
-        for (int d = 0; d < 4; ++d)
-        {
-            if (grid.maze[v].edge[d] == -1)
-                continue;
+    nav.valid = true;
+    nav.cursor = cursor;
+    nav.gridChanges = grid.changeCount();
+    nav.apples = apples;
+    nav.goal = goal;
 
-            QPointF np = grid.maze[v].pos + dirVec[d] * step;
-            int to = grid.addCell(np, step);
+    const int at = grid.cells.Find(cursor);
+    const ExitTable& t = exitTableFor(cur);
+    for (int i = 0; i < 6; ++i)
+        nav.side[i] = t.Distance(i, at);
 
-            if (parent.count(to))
-                continue;
+    const CellPos targets[4] = { apples[0], apples[1], apples[2], goal };
+    portals.Search(grid, at, targets, 4, false);
+    for (int i = 0; i < 4; ++i)
+        nav.target[i] = portals.Distance(i);
+}
 
-            parent[to] = v;
-            q.push(to);
-        }
+// route (cursor to goal) into bfsPath (goal to cursor)
+void HexView::setBfsRoute()
+{
+    bfsPath = QPainterPath();
+    for (int i = route.GetLength() - 1; i >= 0; --i)
+    {
+        const QPointF pt = cellToWorld(grid.cells.Pos(route[i]));
+        if (i == route.GetLength() - 1)
+            bfsPath.moveTo(pt);
+        else
+            bfsPath.lineTo(pt);
     }
-    return {};
 }
 
 void HexView::runBfsToNeighbor(Neighbor n)
 {
-    targetSide = static_cast<int>(n);
-
-    int startId = grid.addCell(cursor.pos, step);
-
-
-    bfsPath = bfsInHex(
-        grid,
-        cur,
-        startId,
-        [this](int id){ return isExitToNeighbor(id); },
-        hexRadius,
-        false
-        );
-    if (bfsPath.GetLength() > 1)
+    exitTableFor(cur).Route(grid.cells, grid.cells.Find(cursor), static_cast<int>(n), route);
+    setBfsRoute();
+    if (bfsPath.elementCount() > 1)
     {
         showNoPath = false;
     }
@@ -880,24 +1023,16 @@ void HexView::runBfsToNeighbor(Neighbor n)
 
 void HexView::runBfsToApple()
 {
-    int startId = grid.addCell(cursor.pos, step);
-
-    bfsPath = bfsInHex(
-        grid,
-        cur,
-        startId,
-        [this](int id){
-            for (int i = 0; i < 3; ++i){
-                if (grid.maze[id].pos == apples[i]){
-                    return true;
-                }
-            }
-            return false;
-        },
-        hexRadius,
-        true
-        );
-    if (bfsPath.GetLength() > 1)
+    refreshNav();
+    int nearest = -1;
+    for (int i = 0; i < 3; ++i)
+        if (nav.target[i] >= 0 && (nearest < 0 || nav.target[i] < nav.target[nearest]))
+            nearest = i;
+    route.Clear();
+    if (nearest >= 0)
+        portals.Trace(grid.cells, nearest, route);
+    setBfsRoute();
+    if (bfsPath.elementCount() > 1)
     {
         showNoPath = false;
     }
@@ -912,19 +1047,12 @@ void HexView::runBfsToApple()
 
 void HexView::runBfsToGoal()
 {
-    int startId = grid.addCell(cursor.pos, step);
-
-    bfsPath = bfsInHex(
-        grid,
-        cur,
-        startId,
-        [this](int id){
-            return grid.maze[id].pos == goal;
-        },
-        hexRadius,
-        true
-        );
-    if (bfsPath.GetLength() > 1)
+    refreshNav();
+    route.Clear();
+    if (nav.target[3] >= 0)
+        portals.Trace(grid.cells, 3, route);
+    setBfsRoute();
+    if (bfsPath.elementCount() > 1)
     {
         showNoPath = false;
     }
@@ -987,6 +1115,19 @@ void HexView::setupNavMenu()
         update();
     });
 
+    // unreachable goals show as such right away
+    const std::array<std::pair<QAction*, Neighbor>, 6> sides = {{
+        {toLU, Neighbor::LeftUp}, {toL, Neighbor::Left}, {toLD, Neighbor::LeftDown},
+        {toRU, Neighbor::RightUp}, {toR, Neighbor::Right}, {toRD, Neighbor::RightDown},
+    }};
+    connect(navMenu, &QMenu::aboutToShow, this, [this, sides, toApple, toPoint]() {
+        refreshNav();
+        for (const auto& [action, side] : sides)
+            action->setEnabled(nav.side[static_cast<int>(side)] > 0);
+        toApple->setEnabled(nav.target[0] > 0 || nav.target[1] > 0 || nav.target[2] > 0);
+        toPoint->setEnabled(nav.target[3] > 0);
+    });
+
     connect(toApple, &QAction::triggered, this, [this]() {
         runBfsToApple();
         update();
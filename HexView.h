@@ -3,7 +3,18 @@
 #include <QPushButton>
 #include <QMenu>
 #include<QElapsedTimer>
+#include <QPicture>
+#include <QImage>
+#include <QLineF>
+#include <QVector>
+#include <QPainterPath>
+#include <random>
+#include "BackgroundGenerator.h"
 #include "HexGrid.h"
+#include "HexMap.h"
+#include "PathHistory.h"
+#include "ExitTable.h"
+#include "PortalGraph.h"
 
 
 enum class Neighbor {
@@ -17,6 +28,46 @@ enum class Neighbor {
 
 
 
+// Corridors of one hex recorded in world coordinates, one picture per
+// pen so the outer strokes of all hexes still go under the inner ones.
+// Zoomed out, the hex is blitted from a small raster instead. Both are
+// built on first use and dropped when the hex revision moves.
+struct HexTile
+{
+    uint32_t revision = 0;
+    bool valid = false;
+    bool recorded = false;
+    QPicture outer;
+    QPicture inner;
+    QImage lowRes;
+};
+
+// World-space lines of the path pieces in one hex. Brought up to date
+// from PathHistory when drawn: whole pieces are appended, and only the
+// last run of the last piece can still grow.
+struct PathTile
+{
+    QPainterPath world;
+    int pieces = 0;     // pieces of the hex drawn so far
+    int runs = 0;       // runs drawn of the last of them
+    CellPos runStart;   // where the last drawn run begins
+};
+
+// Every navigation action answered from one cursor position: the exit
+// tables give the six sides, one portal graph search gives the apples and
+// the goal. Kept until the cursor, the maze, an apple or the goal changes.
+// Distances are corridor steps, -1 when there is no route.
+struct NavAnswers
+{
+    bool valid = false;
+    CellPos cursor = NoCell;
+    uint32_t gridChanges = 0;
+    std::array<CellPos, 3> apples;
+    CellPos goal = NoCell;
+    int side[6] = {};
+    int target[4] = {};  // apples, then the goal
+};
+
 class HexView : public QWidget {
     Q_OBJECT
 public:
@@ -35,60 +86,91 @@ protected:
 
 private:
     QPointF axialToPixel(int q, int r) const;
+    QPointF cellToWorld(const CellPos& c) const;
+    CellPos worldToCell(const QPointF& p) const;
     QPolygonF hexPolygonAt(const QPointF& center) const;
     int sideFromVector(const QPointF& v) const;
-    bool crossedSides(const QPointF& p, ArraySequence<int>& res);
-    void moveToNeighbor(int side, QPointF delta);
+    bool crossedSides(const HexNode* hex, const CellPos& p, ArraySequence<int>& res);
+    // false when the hex could not be joined to the maze; see
+    // HexGenerator::generate
+    bool moveToNeighbor(int side, const CellPos& delta);
+    void restoreAround(HexNode* h);
+    GenRecord captureFor(HexNode* next, const CellPos& start);
+    void speculate();
     void centerCamera();
     QPointF cursorWorldPos() const;
     void spawnApple(int i);
     bool isAppleOnScreen(int i) const;
     void drawApple(QPainter& p);
     void drawApplePointer(QPainter& p, int i);
-    QPointF randomPointInHex(const QPointF& hexCenter);
+    CellPos randomPointInHex(const HexNode* hex);
+    float random01();
     bool isAppleInHex(HexNode* h) const;
     void tryTeleportToPath(const QPointF& screenPos);
-    HexNode* hexAtWorld(const QPointF& world);
+    HexNode* hexAtCell(const CellPos& c);
     HexNode* hexAtAxial(int q, int r);
     bool hasEdgeBetween(const QPointF& a, const QPointF& b);
     bool hasDirectedEdge(const QPointF& from, const QPointF& to);
     void setupNavButton();
     void setupNavMenu();
     void runBfsToNeighbor(Neighbor n);
-    bool isExitToNeighbor(int cellId);
+    const ExitTable& exitTableFor(HexNode* n);
     void runBfsToApple();
-    ArraySequence<QPointF> bfsInHex(HexGrid& grid, HexNode* hex, int startId, std::function<bool(int)> isTarget, float hexRadius, bool apple);
+    void refreshNav();
+    void setBfsRoute();
+    void collectVisibleHexes();
     void drawGeneratedHex(QPainter& p);
     void drawMaze(QPainter& p);
+    HexTile& tileFor(HexNode* n, bool lowRes);
+    QRectF tileWorldRect(HexNode* n) const;
+    QImage rasterTile(HexNode* n, const QVector<QLineF>& lines) const;
+    void collectTileLines(HexNode* n, QVector<QLineF>& lines);
+    void collectRecordLines(HexNode* n, QVector<QLineF>& lines);
+    void recordTile(QPicture& pic, const QVector<QLineF>& lines, const QPen& pen);
     void drawBlackHex(QPainter& p);
     void drawBFS(QPainter& p);
     void drawPathCursor(QPainter& p);
+    PathTile& pathTileFor(const HexNode* n);
     void drawCursor(QPainter& p);
     void drawScore(QPainter& p);
     void drawMessange(QPainter& p);
     void runBfsToGoal();
     void drawGoal(QPainter& p);
-    QPointF pixelToAxial(const QPointF& p) const;
 
 
-    std::array<QPointF, 3> apples;
+    std::array<CellPos, 3> apples;
     int score = 0;
-    QPointF goal;
+    CellPos goal = NoCell;
 
 
-    ArraySequence<QPointF> path;
-    ArraySequence<QPointF>bfsPath;
+    const float hexRadius = 120.0f;
+    const float step = hexRadius / HexGeometry::LatticeRadius;
+    const float roadOuter = step * 0.70f;
+    const float roadInner = step * 0.50f;
+
+    PathHistory path;
+    HexMap<PathTile> pathTiles;
+    QPainterPath bfsPath;  // world space
+    // routes to the sides of recently visited hexes
+    HexMap<ExitTable> exitTables;
+    PortalGraph portals;
+    ArraySequence<int> route;  // cells of the last navigation route
+    NavAnswers nav;
+    // hexes under the widget, refreshed by every paintEvent
+    ArraySequence<HexNode*> visibleHexes;
+    HexMap<HexTile> tiles;
+    QVector<QLineF> tileLines;  // scratch for tile rebuilds
     HexGrid grid;
+    std::mt19937 appleRng;
+    BackgroundGenerator pregen;
     HexNode* cur = nullptr;
-    MazeCell cursor;
+    CellPos cursor;
 
     QPointF camera;
     QPointF cameraDragOffset;
     QPointF lastMouse;
     bool dragging = false;
 
-    const float hexRadius = 120.0f;
-    const float step = hexRadius * 0.05f;
     float zoom = 1.0f;
     int arrowDir = 0;
     const float pi = acos(-1);
@@ -102,6 +184,24 @@ private:
     QElapsedTimer messageTimer;
     const int MESSAGE_TIME_MS = 1000;
 
+    // generated hexes farther than this from the cursor drop their cells
+    const int EVICT_RADIUS = 16;
+    // tile cache is dropped as a whole when it holds this many tiles
+    // beyond the visible ones
+    const int MAX_TILES = 512;
+    const int MAX_EXIT_TABLES = 64;
+    // evicted hexes whose tile a frame may rebuild from the GenRecord
+    const int REPLAYS_PER_FRAME = 8;
+
+    // below LOD_ZOOM the maze layer is drawn from rasters with
+    // LOD_SCALE pixels per world unit
+    const float LOD_ZOOM = 0.35f;
+    const float LOD_SCALE = 0.25f;
+    const float MIN_ZOOM = 0.1f;
+
+    // exits handed to pregen after every move
+    const int SPECULATE_EXITS = 2;
+
 
 
 };
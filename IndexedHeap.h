@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include "DynamicArray.h"
+
+// Binary min-heap of ids with 64-bit keys. The heap position of every id is
+// kept in a dense array, so the key of an id still in the heap can be
+// lowered in place. Storage only grows; Reset empties the heap in O(1).
+class IndexedHeap {
+public:
+    void Reset(int idLimit)
+    {
+        Reserve(idLimit);
+        size = 0;
+    }
+
+    // makes room for ids below idLimit without emptying the heap
+    void Reserve(int idLimit)
+    {
+        if (idLimit > position.GetSize()) {
+            position.Resize(idLimit);
+            entries.Resize(idLimit);
+        }
+    }
+
+    bool Empty() const { return size == 0; }
+    uint64_t TopKey() const { return entries.begin()->key; }
+    int Top() const { return entries.begin()->id; }
+
+    // Only for ids pushed since the last Reset.
+    bool Contains(int id) const { return position.begin()[id] >= 0; }
+    uint64_t Key(int id) const { return entries.begin()[position.begin()[id]].key; }
+
+    // Each id at most once per Reset; Reset or Reserve must have covered it.
+    void Push(int id, uint64_t key)
+    {
+        SiftUp(size++, { key, id });
+    }
+
+    // key must not be above the current one
+    void Lower(int id, uint64_t key)
+    {
+        SiftUp(position.begin()[id], { key, id });
+    }
+
+    int Pop()
+    {
+        Entry* e = entries.begin();
+        const int top = e[0].id;
+        position.begin()[top] = -1;
+        if (--size > 0)
+            SiftDown(0, e[size]);
+        return top;
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        int id;
+    };
+
+    void SiftUp(int i, Entry x)
+    {
+        Entry* e = entries.begin();
+        int* at = position.begin();
+        while (i > 0) {
+            const int up = (i - 1) / 2;
+            if (e[up].key <= x.key)
+                break;
+            e[i] = e[up];
+            at[e[i].id] = i;
+            i = up;
+        }
+        e[i] = x;
+        at[x.id] = i;
+    }
+
+    void SiftDown(int i, Entry x)
+    {
+        Entry* e = entries.begin();
+        int* at = position.begin();
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= size)
+                break;
+            if (child + 1 < size && e[child + 1].key < e[child].key)
+                ++child;
+            if (x.key <= e[child].key)
+                break;
+            e[i] = e[child];
+            at[e[i].id] = i;
+            i = child;
+        }
+        e[i] = x;
+        at[x.id] = i;
+    }
+
+    DynamicArray<Entry> entries;
+    DynamicArray<int> position;
+    int size = 0;
+};
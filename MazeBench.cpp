@@ -0,0 +1,485 @@
+#include "HexGrid.h"
+#include "BackgroundGenerator.h"
+#include "HexGenerator.h"
+#include "FlatIndex.h"
+#include "HexMap.h"
+#include "PathFinder.h"
+#include "PortalGraph.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/resource.h>
+
+// Headless driver: generates every hex within K rings of the origin, ring
+// by ring, and reports generation throughput. With --pregen the next hex
+// is built by BackgroundGenerator while the walker idles for MS ms, and
+// the latency is what is left on the walking thread. With --threads the
+// whole disc is handed to HexGenerator::generateRegion instead. --mapbench
+// N times FlatIndex against std::unordered_map on N packed cell keys and
+// generates nothing, and --hexmap N times HexMap lookups on hex discs of
+// 100 up to N hexes. --paths N runs N random route queries over the
+// generated maze with breadth-first search, A* and the portal graph.
+// --crosscheck N grows N hexes in random order, directly and detached,
+// and fails unless both agree.
+// --expect C makes the run fail unless the edge checksum is C (hex), which
+// is how the ctest entries in CMakeLists.txt pin generation output, and
+// --min-reach P unless at least P percent of the cells can be reached from
+// the origin.
+
+struct Options
+{
+    int rings = 10;
+    uint64_t seed = 1;
+    int evictRadius = -1;
+    int pregenMs = -1;
+    int threads = 0;
+    int mapKeys = 0;
+    int hexMapSize = 0;
+    int pathQueries = 0;
+    int crossCheck = 0;
+    bool checkChecksum = false;
+    uint64_t expected = 0;
+    double minReachPercent = 0;
+};
+
+static void usage(const char* argv0)
+{
+    std::printf("usage: %s [--rings K] [--seed S] [--evict D] [--pregen MS] [--threads N] [--mapbench N] [--hexmap N] [--paths N] [--crosscheck N] [--expect C] [--min-reach P]\n", argv0);
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--rings") && i + 1 < argc)
+            opt.rings = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc)
+            opt.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--evict") && i + 1 < argc)
+            opt.evictRadius = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--pregen") && i + 1 < argc)
+            opt.pregenMs = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+            opt.threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--mapbench") && i + 1 < argc)
+            opt.mapKeys = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--hexmap") && i + 1 < argc)
+            opt.hexMapSize = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--paths") && i + 1 < argc)
+            opt.pathQueries = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--crosscheck") && i + 1 < argc)
+            opt.crossCheck = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--expect") && i + 1 < argc) {
+            opt.checkChecksum = true;
+            opt.expected = std::strtoull(argv[++i], nullptr, 16);
+        }
+        else if (!std::strcmp(argv[i], "--min-reach") && i + 1 < argc)
+            opt.minReachPercent = std::atof(argv[++i]);
+        else
+            return false;
+    }
+    return opt.rings >= 0;
+}
+
+// Hexes of ring k (k >= 1) around the origin, in walking order.
+static std::vector<std::pair<int, int>> ring(int k)
+{
+    std::vector<std::pair<int, int>> res;
+    int q = HexGeometry::hexDq[4] * k;
+    int r = HexGeometry::hexDr[4] * k;
+    for (int side = 0; side < 6; ++side)
+        for (int i = 0; i < k; ++i) {
+            res.push_back({q, r});
+            q += HexGeometry::hexDq[side];
+            r += HexGeometry::hexDr[side];
+        }
+    return res;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t i = size_t(p * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static long peakRssKb()
+{
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// Inserts n cell keys of a square lattice patch, then looks every one up
+// in shuffled order and as many absent keys just beside the patch.
+template <class Insert, class Find, class Bytes>
+static void timeMap(const char* name, int n, Insert&& insert, Find&& find, Bytes&& bytes)
+{
+    using Clock = std::chrono::steady_clock;
+    const int side = int(std::ceil(std::sqrt(double(n))));
+    std::vector<uint64_t> keys(n), misses(n);
+    for (int i = 0; i < n; ++i) {
+        CellPos p = { i % side - side / 2, i / side - side / 2 };
+        keys[i] = cellKey(p);
+        misses[i] = cellKey({ p.x + side, p.y });
+    }
+
+    auto t = Clock::now();
+    for (int i = 0; i < n; ++i)
+        insert(keys[i], i);
+    double insertNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / n;
+
+    std::mt19937 rng(1);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::shuffle(misses.begin(), misses.end(), rng);
+    long sum = 0;
+    t = Clock::now();
+    for (uint64_t k : keys)
+        sum += find(k);
+    double hitNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / n;
+    t = Clock::now();
+    for (uint64_t k : misses)
+        sum += find(k);
+    double missNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / n;
+
+    std::printf("%-14s %10d keys  insert %6.1f ns  hit %6.1f ns  miss %6.1f ns  %8zu KiB  (%ld)\n",
+                name, n, insertNs, hitNs, missNs, bytes() / 1024, sum);
+}
+
+static int runMapBench(int n)
+{
+    {
+        FlatIndex index;
+        timeMap("FlatIndex", n,
+                [&](uint64_t k, int v) { index.Insert(k, v); },
+                [&](uint64_t k) { return index.Find(k); },
+                [&] { return index.MemoryBytes(); });
+    }
+    {
+        std::unordered_map<uint64_t, int> index;
+        timeMap("unordered_map", n,
+                [&](uint64_t k, int v) { index[k] = v; },
+                [&](uint64_t k) {
+                    auto it = index.find(k);
+                    return it == index.end() ? -1 : it->second;
+                },
+                // one node (next, key, value) per entry plus the bucket array
+                [&] { return index.size() * (sizeof(void*) + sizeof(uint64_t) + sizeof(int) + 4) +
+                             index.bucket_count() * sizeof(void*); });
+    }
+    std::printf("peak RSS         %ld KiB\n", peakRssKb());
+    return 0;
+}
+
+// For disc sizes from 100 up to n hexes by factors of ten: inserts every
+// hex of the disc into a HexMap, then looks each one up in shuffled order
+// and as many hexes lying off the disc. Fails on a wrong answer.
+static int runHexMapBench(int n)
+{
+    using Clock = std::chrono::steady_clock;
+    std::mt19937 rng(1);
+    for (int size = 100; size <= n; size *= 10) {
+        std::vector<std::pair<int, int>> hexes = { {0, 0} };
+        int k = 1;
+        for (; int(hexes.size()) < size; ++k)
+            for (auto hex : ring(k))
+                hexes.push_back(hex);
+        hexes.resize(size);
+
+        HexMap<int> map;
+        auto t = Clock::now();
+        for (int i = 0; i < size; ++i)
+            map.Insert(hexes[i].first, hexes[i].second, i);
+        double insertNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / size;
+
+        std::vector<int> order(size);
+        for (int i = 0; i < size; ++i)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        long wrong = 0;
+        t = Clock::now();
+        for (int i : order) {
+            const int* v = map.Find(hexes[i].first, hexes[i].second);
+            wrong += !v || *v != i;
+        }
+        double hitNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / size;
+        // shifted two disc radii along q, so off the disc
+        t = Clock::now();
+        for (int i : order)
+            wrong += map.Find(hexes[i].first + 2 * k, hexes[i].second) != nullptr;
+        double missNs = std::chrono::duration<double, std::nano>(Clock::now() - t).count() / size;
+
+        std::printf("HexMap     %8d hexes  insert %6.1f ns  hit %6.1f ns  miss %6.1f ns\n",
+                    size, insertNs, hitNs, missNs);
+        if (wrong > 0) {
+            std::printf("wrong lookups    %ld\n", wrong);
+            return 2;
+        }
+    }
+    std::printf("peak RSS         %ld KiB\n", peakRssKb());
+    return 0;
+}
+
+// Order-independent, so runs with eviction can be compared by seed.
+static uint64_t edgeChecksum(const HexGrid& grid)
+{
+    uint64_t checksum = 0;
+    for (int id = 0; id < grid.cells.IdLimit(); ++id)
+        if (grid.cells.Contains(id))
+            for (int d = 0; d < 4; ++d)
+                if (grid.cells.Neighbor(id, d) >= 0)
+                    checksum += (cellKey(grid.cells.Pos(id)) * 4 + d) * 0x9E3779B97F4A7C15ull;
+    return checksum;
+}
+
+// Grows two grids hex by hex, picking from the frontier at random: one
+// with generate, the other with generateDetached and commit. Both must
+// answer the same for every hex and end with the same maze.
+static int runCrossCheck(int hexes, uint64_t seed)
+{
+    HexGrid direct(seed);
+    HexGrid detached(seed);
+    std::mt19937_64 rng(seed);
+    int mismatches = 0;
+    int unjoined = 0;
+    for (int i = 0; i < hexes; ++i) {
+        HexNode* a = i == 0 ? direct.root() : direct.frontierHex(int(rng() % direct.frontierSize()));
+        HexNode* b = detached.getOrCreate(a->q, a->r);
+        direct.ensureNeighbors(a);
+        detached.ensureNeighbors(b);
+        GenRecord rec = HexGenerator::capture(direct, a, HexGenerator::entryPoint(direct, a));
+        if (!HexGenerator::sameInputs(rec, HexGenerator::capture(detached, b, HexGenerator::entryPoint(detached, b)))) {
+            std::printf("inputs differ at hex (%d, %d)\n", a->q, a->r);
+            return 2;
+        }
+        GenResult res;
+        HexGenerator::generateDetached(b->q, b->r, rec, seed, res);
+        const bool joined = HexGenerator::generate(direct, a, rec);
+        if (joined != HexGenerator::commit(detached, b, res)) {
+            std::printf("hex (%d, %d): generate %d, detached %d\n", a->q, a->r, joined, !joined);
+            ++mismatches;
+        }
+        unjoined += !joined;
+        if (direct.frontierSize() == 0)
+            break;
+    }
+    const uint64_t checksum = edgeChecksum(direct);
+    std::printf("hexes            %d\n", hexes);
+    std::printf("not joined       %d\n", unjoined);
+    std::printf("mismatches       %d\n", mismatches);
+    std::printf("edge checksum    %016llx / %016llx\n", (unsigned long long)checksum,
+                (unsigned long long)edgeChecksum(detached));
+    return mismatches == 0 && checksum == edgeChecksum(detached) ? 0 : 2;
+}
+
+// Routes between random pairs of stored cells, as the goal query does.
+// The portal graph runs the batch twice: the first pass also builds the
+// blocks it reaches.
+static void runPathBench(HexGrid& grid, int queries, uint64_t seed)
+{
+    using Clock = std::chrono::steady_clock;
+    std::vector<int> ids;
+    for (int id = 0; id < grid.cells.IdLimit(); ++id)
+        if (grid.cells.Contains(id))
+            ids.push_back(id);
+    if (ids.empty())
+        return;
+
+    std::mt19937_64 rng(seed);
+    std::vector<std::pair<int, CellPos>> pairs;
+    for (int i = 0; i < queries; ++i) {
+        const int start = ids[rng() % ids.size()];
+        pairs.push_back({ start, grid.cells.Pos(ids[rng() % ids.size()]) });
+    }
+
+    PathFinder finder;
+    PortalGraph portals;
+    ArraySequence<int> route;
+    // [0] reachable targets, [1] the rest
+    double bfsUs[2] = {}, astarUs[2] = {}, portalUs[2] = {}, coldUs = 0;
+    long bfsExpanded[2] = {}, astarExpanded[2] = {}, portalExpanded[2] = {};
+    int queriesOf[2] = {}, mismatched = 0;
+    std::vector<int> lengths;
+    for (auto [start, target] : pairs) {
+        auto t = Clock::now();
+        int a = finder.Search(grid.cells, start,
+                              [&](int id) { return grid.cells.Pos(id) == target; },
+                              [](int) { return true; });
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - t).count();
+        const int k = a >= 0 ? 0 : 1;
+        const int bfsLength = a >= 0 ? finder.Distance(a) : -1;
+        bfsUs[k] += us;
+        bfsExpanded[k] += finder.Expanded();
+
+        t = Clock::now();
+        int b = finder.SearchNearest(grid.cells, start, &target, 1);
+        astarUs[k] += std::chrono::duration<double, std::micro>(Clock::now() - t).count();
+        astarExpanded[k] += finder.Expanded();
+        const int astarLength = b >= 0 ? finder.Distance(b) : -1;
+
+        ++queriesOf[k];
+        mismatched += bfsLength != astarLength;
+        lengths.push_back(bfsLength);
+    }
+    for (int pass = 0; pass < 2; ++pass)
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            auto t = Clock::now();
+            int c = portals.Route(grid, pairs[i].first, &pairs[i].second, 1, route);
+            double us = std::chrono::duration<double, std::micro>(Clock::now() - t).count();
+            if (pass == 0) {
+                coldUs += us;
+                mismatched += (c >= 0 ? route.GetLength() - 1 : -1) != lengths[i];
+                continue;
+            }
+            const int k = lengths[i] >= 0 ? 0 : 1;
+            portalUs[k] += us;
+            portalExpanded[k] += portals.Expanded();
+        }
+
+    std::printf("path queries     %d (%d unreachable, %d length mismatches)\n", queries, queriesOf[1], mismatched);
+    const char* kind[2] = { "reachable", "unreachable" };
+    for (int k = 0; k < 2; ++k) {
+        const double n = std::max(queriesOf[k], 1);
+        std::printf("  %-12s   bfs %8.0f cells %9.1f us   a* %8.0f cells %9.1f us   portal %6.0f nodes %7.1f us\n",
+                    kind[k], bfsExpanded[k] / n, bfsUs[k] / n, astarExpanded[k] / n, astarUs[k] / n,
+                    portalExpanded[k] / n, portalUs[k] / n);
+    }
+    std::printf("portal blocks    %d built, first pass %.1f us/query\n", portals.Rebuilt(), coldUs / queries);
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.mapKeys > 0)
+        return runMapBench(opt.mapKeys);
+    if (opt.hexMapSize > 0)
+        return runHexMapBench(opt.hexMapSize);
+    if (opt.crossCheck > 0)
+        return runCrossCheck(opt.crossCheck, opt.seed);
+
+    using Clock = std::chrono::steady_clock;
+    HexGrid grid(opt.seed);
+    std::vector<double> latencyUs;
+    int hexes = 0;
+    long generatedCells = 0;
+
+    std::vector<HexNode*> order;
+    order.push_back(grid.root());
+    for (int k = 1; k <= opt.rings; ++k)
+        for (auto [q, r] : ring(k))
+            order.push_back(grid.getOrCreate(q, r));
+
+    BackgroundGenerator pregen(opt.seed);
+    int pregenHits = 0;
+    double idleSeconds = 0;
+
+    auto t0 = Clock::now();
+    auto generate = [&](HexNode* hex) {
+        grid.ensureNeighbors(hex);
+        CellPos start = HexGenerator::entryPoint(grid, hex);
+        int before = grid.cells.GetCount();
+        auto s = Clock::now();
+        GenRecord rec = HexGenerator::capture(grid, hex, start);
+        GenResult res;
+        bool joined;
+        if (opt.pregenMs >= 0 && pregen.take(hex->q, hex->r, rec, res)) {
+            joined = HexGenerator::commit(grid, hex, res);
+            ++pregenHits;
+        } else {
+            joined = HexGenerator::generate(grid, hex, rec);
+        }
+        generatedCells += grid.cells.GetCount() - before;
+        latencyUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - s).count());
+        hexes += joined;
+        if (opt.evictRadius >= 0)
+            grid.evictFarFrom(hex, opt.evictRadius);
+    };
+    // queue the next hex of the walk, then let the worker run
+    auto speculate = [&](size_t i) {
+        for (; i < order.size() && order[i]->state == HexState::Generated; ++i) {}
+        if (i == order.size())
+            return;
+        HexNode* next = order[i];
+        grid.ensureNeighbors(next);
+        ArraySequence<GenJob> jobs;
+        CellPos start = HexGenerator::entryPoint(grid, next);
+        jobs.Append({next->q, next->r, HexGenerator::capture(grid, next, start)});
+        pregen.request(jobs);
+        auto s = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(opt.pregenMs));
+        idleSeconds += std::chrono::duration<double>(Clock::now() - s).count();
+    };
+
+    generate(grid.root());
+    if (opt.threads > 0) {
+        int before = grid.cells.GetCount();
+        hexes += HexGenerator::generateRegion(grid, grid.root(), opt.rings, opt.threads);
+        generatedCells += grid.cells.GetCount() - before;
+    }
+    // each hex is tried once: one that could not be joined stays Linked
+    for (size_t i = 1; opt.threads == 0 && i < order.size(); ++i) {
+        if (order[i]->state == HexState::Generated)
+            continue;
+        if (opt.pregenMs >= 0)
+            speculate(i);
+        generate(order[i]);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - t0).count() - idleSeconds;
+
+    std::sort(latencyUs.begin(), latencyUs.end());
+    const uint64_t checksum = edgeChecksum(grid);
+
+    // the root hex is entered at its centre, the lattice origin
+    PathFinder flood;
+    int reachable = 0;
+    if (int origin = grid.cells.Find(CellPos{ 0, 0 }); origin >= 0) {
+        flood.Search(grid.cells, origin, [](int) { return false; }, [](int) { return true; });
+        for (int id = 0; id < grid.cells.IdLimit(); ++id)
+            reachable += grid.cells.Contains(id) && flood.Reached(id);
+    }
+    const double reachPercent = 100.0 * reachable / std::max(grid.cells.GetCount(), 1);
+
+    std::printf("rings            %d\n", opt.rings);
+    std::printf("hexes            %d\n", hexes);
+    std::printf("seed             %llu\n", (unsigned long long)opt.seed);
+    std::printf("cells            %ld\n", generatedCells);
+    std::printf("resident cells   %d\n", grid.cells.GetCount());
+    std::printf("cell store       %zu KiB\n", grid.cells.MemoryBytes() / 1024);
+    std::printf("edge checksum    %016llx\n", (unsigned long long)checksum);
+    std::printf("reachable cells  %d (%.1f%% of resident)\n", reachable, reachPercent);
+    std::printf("wall time        %.3f s\n", seconds);
+    std::printf("hexes/sec        %.1f\n", hexes / seconds);
+    std::printf("cells/sec        %.0f\n", generatedCells / seconds);
+    if (opt.pregenMs >= 0)
+        std::printf("pregen hits      %d\n", pregenHits);
+    std::printf("peak RSS         %ld KiB\n", peakRssKb());
+    if (opt.pathQueries > 0)
+        runPathBench(grid, opt.pathQueries, opt.seed);
+    if (opt.checkChecksum && checksum != opt.expected) {
+        std::printf("checksum mismatch: expected %016llx\n", (unsigned long long)opt.expected);
+        return 2;
+    }
+    if (reachPercent < opt.minReachPercent) {
+        std::printf("reachability below %.1f%%\n", opt.minReachPercent);
+        return 2;
+    }
+    if (opt.threads > 0) {
+        std::printf("threads          %d\n", opt.threads);
+        return 0;
+    }
+    std::printf("latency (us)     p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                percentile(latencyUs, 0.50), percentile(latencyUs, 0.90),
+                percentile(latencyUs, 0.99), latencyUs.empty() ? 0.0 : latencyUs.back());
+    return 0;
+}
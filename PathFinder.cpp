@@ -0,0 +1,61 @@
+#include "PathFinder.h"
+#include <cstdlib>
+
+uint64_t PathFinder::HeapKey(int estimate, int dist)
+{
+    return (uint64_t(uint32_t(estimate)) << 32) | uint32_t(INT32_MAX - dist);
+}
+
+int PathFinder::Estimate(const CellPos& p, const CellPos* targets, int count)
+{
+    int64_t best = INT32_MAX / 2;
+    for (int i = 0; i < count; ++i) {
+        int64_t d = std::llabs(int64_t(p.x) - targets[i].x) + std::llabs(int64_t(p.y) - targets[i].y);
+        if (d < best)
+            best = d;
+    }
+    return int(best);
+}
+
+int PathFinder::SearchNearest(const CellStore& cells, int start, const CellPos* targets, int count)
+{
+    Begin(cells.IdLimit());
+    heap.Reset(cells.IdLimit());
+    if (count <= 0)
+        return -1;
+
+    uint32_t* seen = stamp.begin();
+    int* from = parent.begin();
+    int* dist = distance.begin();
+
+    Reach(start, -1, 0);
+    heap.Push(start, HeapKey(Estimate(cells.Pos(start), targets, count), 0));
+    while (!heap.Empty()) {
+        const int left = int(heap.TopKey() >> 32);
+        const int v = heap.Pop();
+        ++expanded;
+
+        // the estimate is zero exactly on a target
+        if (left == dist[v])
+            return v;
+
+        const int g = dist[v] + 1;
+        for (int d = 0; d < 4; ++d) {
+            const int to = cells.Neighbor(v, d);
+            if (to < 0)
+                continue;
+            if (seen[to] != epoch) {
+                seen[to] = epoch;
+                from[to] = v;
+                dist[to] = g;
+                heap.Push(to, HeapKey(g + Estimate(cells.Pos(to), targets, count), g));
+            } else if (heap.Contains(to) && g < dist[to]) {
+                const int f = int(heap.Key(to) >> 32) - (dist[to] - g);
+                from[to] = v;
+                dist[to] = g;
+                heap.Lower(to, HeapKey(f, g));
+            }
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include "CellStore.h"
+#include "DynamicArray.h"
+#include "IndexedHeap.h"
+
+// Shortest paths over the corridors of a CellStore, following edge masks
+// only; the store is never modified. Parents and distances live in
+// dense arrays indexed by cell id and stamped per search, and the frontier
+// is a FIFO over a reused id array (every cell enters it at most once), so
+// once the arrays have grown to the store's IdLimit a search allocates
+// nothing.
+class PathFinder {
+public:
+    // Searches from start until isTarget(id) holds. Cells for which
+    // expand(id) is false are reached but not left. Returns the target
+    // found with the fewest steps, or -1.
+    template <class Target, class Expand>
+    int Search(const CellStore& cells, int start, Target&& isTarget, Expand&& expand)
+    {
+        Begin(cells.IdLimit());
+        int head = 0, tail = 0;
+        Reach(start, -1, 0);
+        frontier[tail++] = start;
+        while (head < tail) {
+            const int v = frontier[head++];
+            ++expanded;
+            if (isTarget(v))
+                return v;
+            if (!expand(v))
+                continue;
+            for (int d = 0; d < 4; ++d) {
+                const int to = cells.Neighbor(v, d);
+                if (to < 0 || Reached(to))
+                    continue;
+                Reach(to, v, distance[v] + 1);
+                frontier[tail++] = to;
+            }
+        }
+        return -1;
+    }
+
+    // A* towards whichever of targets[0..count) is closest by corridor,
+    // guided by the lattice Manhattan distance to the nearest of them. A
+    // corridor step moves one lattice unit, so the estimate never
+    // overshoots and the path found is as short as Search's. Returns the
+    // target cell reached, or -1.
+    int SearchNearest(const CellStore& cells, int start, const CellPos* targets, int count);
+
+    // cells taken off the frontier by the last search
+    int Expanded() const { return expanded; }
+
+    // valid for the last search
+    bool Reached(int id) const { return id < stamp.GetSize() && stamp[id] == epoch; }
+    // -1 for the start cell
+    int Parent(int id) const { return parent[id]; }
+    int Distance(int id) const { return distance[id]; }
+
+    // Lattice Manhattan distance from p to the nearest of targets, capped
+    // so that adding a path length cannot overflow.
+    static int Estimate(const CellPos& p, const CellPos* targets, int count);
+    // heap order: lower distance + estimate first, then the deeper cell
+    static uint64_t HeapKey(int estimate, int dist);
+
+private:
+
+    void Begin(int idLimit)
+    {
+        if (++epoch == 0) {
+            for (uint32_t& s : stamp)
+                s = 0;
+            epoch = 1;
+        }
+        if (idLimit > stamp.GetSize()) {
+            const int old = stamp.GetSize();
+            stamp.Resize(idLimit);
+            for (int i = old; i < idLimit; ++i)
+                stamp[i] = 0;
+            parent.Resize(idLimit);
+            distance.Resize(idLimit);
+            frontier.Resize(idLimit);
+        }
+        expanded = 0;
+    }
+
+    void Reach(int id, int from, int dist)
+    {
+        stamp[id] = epoch;
+        parent[id] = from;
+        distance[id] = dist;
+    }
+
+    DynamicArray<uint32_t> stamp;
+    DynamicArray<int> parent;
+    DynamicArray<int> distance;
+    // FIFO of Search
+    DynamicArray<int> frontier;
+    // open cells of SearchNearest
+    IndexedHeap heap;
+    int expanded = 0;
+    uint32_t epoch = 0;
+};
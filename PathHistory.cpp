@@ -0,0 +1,56 @@
+#include "PathHistory.h"
+#include <algorithm>
+
+void PathHistory::Open(const CellPos& p)
+{
+    HexGeometry::nearestHex(p.x, p.y, pieceQ, pieceR);
+    Piece piece;
+    piece.start = p;
+    piece.first = runs.GetLength();
+    byHex.GetOrInsert(pieceQ, pieceR).Append(pieces.GetLength());
+    pieces.Append(piece);
+}
+
+void PathHistory::Start(const CellPos& p)
+{
+    last = p;
+    Open(p);
+}
+
+void PathHistory::Step(int d)
+{
+    Piece& piece = pieces[pieces.GetLength() - 1];
+    const int k = runs.GetLength() - 1;
+    if (piece.count > 0 && (runs[k] & 3) == d && (runs[k] >> 2) + 1 < MaxRun) {
+        runs[k] += 4;
+    } else {
+        runs.Append(uint8_t(d));
+        ++piece.count;
+    }
+    last = last + HexGeometry::dirStep[d];
+
+    // every point lies in a piece of its own hex, so Visited finds it there
+    int q, r;
+    HexGeometry::nearestHex(last.x, last.y, q, r);
+    if (q != pieceQ || r != pieceR)
+        Open(last);
+}
+
+bool PathHistory::Visited(const CellPos& p) const
+{
+    int q, r;
+    HexGeometry::nearestHex(p.x, p.y, q, r);
+    const ArraySequence<int>* list = byHex.Find(q, r);
+    if (!list)
+        return false;
+    for (int i = 0; i < list->GetLength(); ++i) {
+        bool found = pieces[(*list)[i]].start == p;
+        ForEachRun((*list)[i], [&](const CellPos& a, const CellPos& b) {
+            found = found || (std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x) &&
+                              std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y));
+        });
+        if (found)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include "ArraySequence.h"
+#include "HexGeometry.h"
+#include "HexMap.h"
+
+// The cursor's path as run-length coded moves: one byte per run of up to
+// MaxRun steps in one direction, the direction in the low two bits and the
+// length minus one above them. The path is cut into pieces that each lie
+// in one hex: a piece starts at a point of its hex and every step of it
+// leaves from a point of that hex, so only its last step may end in the
+// next hex, where the next piece starts. Start begins a new segment, which
+// is not joined to the one before.
+//
+// Every hex lists its pieces, so drawing and picking visit only the hexes
+// they look at, and a long walk costs about a byte per step.
+class PathHistory {
+public:
+    static constexpr int MaxRun = 64;
+
+    struct Piece {
+        CellPos start;
+        int first = 0;  // first run in runs
+        int count = 0;
+    };
+
+    // starts a new segment at p
+    void Start(const CellPos& p);
+    // one lattice step in direction d from Last(); needs a Start first
+    void Step(int d);
+    CellPos Last() const { return last; }
+
+    int GetPieceCount() const { return pieces.GetLength(); }
+    const Piece& GetPiece(int i) const { return pieces[i]; }
+    // pieces starting in hex (q, r), nullptr when there are none
+    const ArraySequence<int>* PiecesIn(int q, int r) const { return byHex.Find(q, r); }
+
+    // lattice offset covered by run k of piece i; the last run of the
+    // last piece grows while the cursor keeps its direction
+    CellPos RunOffset(int i, int k) const
+    {
+        const uint8_t run = runs[pieces[i].first + k];
+        const CellPos step = HexGeometry::dirStep[run & 3];
+        const int length = (run >> 2) + 1;
+        return { step.x * length, step.y * length };
+    }
+
+    // Calls visit(from, to) for every run of piece i, from its start on;
+    // a run is the straight line between the two points.
+    template <class F>
+    void ForEachRun(int i, F&& visit) const
+    {
+        CellPos at = pieces[i].start;
+        for (int k = 0; k < pieces[i].count; ++k) {
+            const CellPos to = at + RunOffset(i, k);
+            visit(at, to);
+            at = to;
+        }
+    }
+
+    // whether the path passed through p; looks at the pieces of p's hex
+    bool Visited(const CellPos& p) const;
+
+private:
+    void Open(const CellPos& p);
+
+    ArraySequence<uint8_t> runs;
+    ArraySequence<Piece> pieces;
+    HexMap<ArraySequence<int>> byHex;
+    CellPos last = NoCell;
+    // hex of the current piece
+    int pieceQ = 0;
+    int pieceR = 0;
+};
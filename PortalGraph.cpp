@@ -0,0 +1,353 @@
+#include "PortalGraph.h"
+#include <algorithm>
+#include <climits>
+
+static int bitCount(uint8_t m)
+{
+    return (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + ((m >> 3) & 1);
+}
+
+static int blockOf(int id)
+{
+    return id / CellStore::BlockCells;
+}
+
+PortalGraph::Block& PortalGraph::Ensure(HexGrid& grid, int slot)
+{
+    while (blocks.GetLength() <= slot)
+        blocks.Append(Block());
+    Block& b = blocks[slot];
+    // the grid does not change during a Route
+    if (b.built && b.checked == epoch)
+        return b;
+    b.checked = epoch;
+
+    int q, r;
+    grid.cells.HexOf(slot * CellStore::BlockCells, q, r);
+    const HexNode* n = grid.find(q, r);
+    const uint32_t revision = n ? n->revision : 0;
+    if (b.built && b.q == q && b.r == r && b.revision == revision)
+        return b;
+
+    Build(grid.cells, slot, b);
+    b.q = q;
+    b.r = r;
+    b.revision = revision;
+    b.built = true;
+    b.epoch = 0;
+    ++rebuilt;
+    return b;
+}
+
+enum : uint8_t { Absent = 0, Portal = 1, Inner = 2, Pruned = 4, Junction = 8 };
+
+void PortalGraph::Build(const CellStore& cells, int slot, Block& b)
+{
+    const int base = slot * CellStore::BlockCells;
+    pending.Clear();
+
+    // live starts as every corridor with a cell on its far end
+    for (int i = 0; i < CellStore::BlockCells; ++i) {
+        live[i] = 0;
+        kind[i] = Absent;
+        if (!cells.Contains(base + i))
+            continue;
+        kind[i] = Inner;
+        for (int d = 0; d < 4; ++d) {
+            const int to = cells.Neighbor(base + i, d);
+            if (to < 0)
+                continue;
+            live[i] |= uint8_t(1 << d);
+            if (blockOf(to) != slot)
+                kind[i] = Portal;
+        }
+        if (kind[i] == Inner && bitCount(live[i]) <= 1)
+            pending.Append(i);
+    }
+
+    // peel dead ends; a portal is never peeled, so neither is the way to it
+    while (pending.GetLength() > 0) {
+        const int i = pending.GetLast();
+        pending.RemoveLast();
+        if (kind[i] == Pruned)
+            continue;
+        kind[i] = Pruned;
+        for (int d = 0; d < 4; ++d) {
+            if (!(live[i] & (1 << d)))
+                continue;
+            const int j = cells.Neighbor(base + i, d) - base;
+            live[j] &= uint8_t(~(1 << (d ^ 1)));
+            if (kind[j] == Inner && bitCount(live[j]) <= 1)
+                pending.Append(j);
+        }
+    }
+
+    b.junctions.Clear();
+    for (int i = 0; i < CellStore::BlockCells; ++i) {
+        if (kind[i] == Portal || (kind[i] == Inner && bitCount(live[i]) != 2)) {
+            kind[i] |= Junction;
+            b.junctions.Append(i);
+        }
+    }
+
+    b.firstArc.Clear();
+    b.arcs.Clear();
+    b.steps.Clear();
+    for (int k = 0; k < b.junctions.GetLength(); ++k) {
+        const int from = base + b.junctions[k];
+        b.firstArc.Append(b.arcs.GetLength());
+        for (int d = 0; d < 4; ++d) {
+            if (!(live[from - base] & (1 << d)))
+                continue;
+            Arc arc;
+            arc.steps = b.steps.GetLength();
+            int at = cells.Neighbor(from, d);
+            int in = d;
+            b.steps.Append(uint8_t(d));
+            arc.length = 1;
+            // a run of two-way cells ends at a junction, possibly this one
+            while (blockOf(at) == slot && !(kind[at - base] & Junction)) {
+                uint8_t next = live[at - base] & uint8_t(~(1 << (in ^ 1)));
+                in = next & 1 ? 0 : next & 2 ? 1 : next & 4 ? 2 : 3;
+                b.steps.Append(uint8_t(in));
+                at = cells.Neighbor(at, in);
+                ++arc.length;
+            }
+            if (at == from) {
+                for (int s = 0; s < arc.length; ++s)
+                    b.steps.RemoveLast();
+                continue;
+            }
+            arc.to = at;
+            b.arcs.Append(arc);
+        }
+    }
+    b.firstArc.Append(b.arcs.GetLength());
+}
+
+int PortalGraph::JunctionIndex(const Block& b, int offset)
+{
+    int lo = 0, hi = b.junctions.GetLength() - 1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        const int at = b.junctions[mid];
+        if (at == offset)
+            return mid;
+        if (at < offset)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+int PortalGraph::NodeFor(HexGrid& grid, int cell)
+{
+    const int slot = blockOf(cell);
+    Block& b = Ensure(grid, slot);
+    const int k = JunctionIndex(b, cell - slot * CellStore::BlockCells);
+    if (k < 0)
+        return -1;
+    if (b.epoch != epoch) {
+        b.epoch = epoch;
+        b.node.Clear();
+        for (int i = 0; i < b.junctions.GetLength(); ++i)
+            b.node.Append(-1);
+    }
+    if (b.node[k] < 0) {
+        b.node[k] = nodeCount;
+        if (nodeCount >= nodes.GetSize())
+            nodes.Resize(nodeCount + 1);
+        nodes[nodeCount] = Node();
+        nodes[nodeCount].cell = cell;
+        nodes[nodeCount].dist = INT_MAX;
+        heap.Reserve(++nodeCount);
+    }
+    return b.node[k];
+}
+
+void PortalGraph::SearchBlock(const CellStore& cells, int from, int to)
+{
+    const int slot = blockOf(from);
+    cellSearch.Search(cells, from,
+                      [&](int id) { return id == to; },
+                      [&](int id) { return blockOf(id) == slot; });
+    expanded += cellSearch.Expanded();
+}
+
+// Settles target t when the best remaining estimate cannot beat it. With
+// nearestOnly only the nearest target is needed.
+int PortalGraph::Bound(bool nearestOnly) const
+{
+    int bound = nearestOnly ? INT_MAX : -1;
+    for (int t = 0; t < targetCount; ++t) {
+        if (targetCell[t] < 0)
+            continue;
+        bound = nearestOnly ? std::min(bound, best[t]) : std::max(bound, best[t]);
+    }
+    return bound;
+}
+
+int PortalGraph::Search(HexGrid& grid, int start, const CellPos* targets, int count, bool nearestOnly)
+{
+    const CellStore& cells = grid.cells;
+    expanded = 0;
+    origin = start;
+    targetCount = std::min(count, MaxTargets);
+    for (int t = 0; t < targetCount; ++t) {
+        targetCell[t] = start < 0 ? -1 : cells.Find(targets[t]);
+        best[t] = INT_MAX;
+        bestNode[t] = -1;
+    }
+    if (start < 0 || targetCount <= 0)
+        return -1;
+    if (++epoch == 0) {
+        for (Block& b : blocks)
+            b.epoch = b.checked = 0;
+        epoch = 1;
+    }
+    nodeCount = 0;
+    heap.Reset(0);
+
+    // corridor distance from each target to the junctions of its block
+    for (int t = 0; t < targetCount; ++t) {
+        const int id = targetCell[t];
+        if (id < 0)
+            continue;
+        const int slot = blockOf(id);
+        SearchBlock(cells, id, -1);
+        Block& b = Ensure(grid, slot);
+        for (int k = 0; k < b.junctions.GetLength(); ++k) {
+            const int cell = slot * CellStore::BlockCells + b.junctions[k];
+            if (cellSearch.Reached(cell))
+                nodes[NodeFor(grid, cell)].toTarget[t] = cellSearch.Distance(cell);
+        }
+    }
+
+    // the start block by cells: targets in it, and the seeds
+    const int startSlot = blockOf(start);
+    SearchBlock(cells, start, -1);
+    for (int t = 0; t < targetCount; ++t)
+        if (targetCell[t] >= 0 && cellSearch.Reached(targetCell[t]))
+            best[t] = cellSearch.Distance(targetCell[t]);
+    {
+        Block& b = Ensure(grid, startSlot);
+        for (int k = 0; k < b.junctions.GetLength(); ++k) {
+            const int cell = startSlot * CellStore::BlockCells + b.junctions[k];
+            if (!cellSearch.Reached(cell))
+                continue;
+            const int v = NodeFor(grid, cell);
+            nodes[v].dist = cellSearch.Distance(cell);
+            heap.Push(v, PathFinder::HeapKey(nodes[v].dist + PathFinder::Estimate(cells.Pos(cell), targets, targetCount),
+                                             nodes[v].dist));
+        }
+    }
+
+    // A* over junctions, guided towards the nearest target
+    while (!heap.Empty() && int(heap.TopKey() >> 32) < Bound(nearestOnly)) {
+        const int v = heap.Pop();
+        ++expanded;
+        const Node at = nodes[v];
+        for (int t = 0; t < targetCount; ++t) {
+            if (at.toTarget[t] >= 0 && at.dist + at.toTarget[t] < best[t]) {
+                best[t] = at.dist + at.toTarget[t];
+                bestNode[t] = v;
+            }
+        }
+
+        const int slot = blockOf(at.cell);
+        Block& b = Ensure(grid, slot);
+        const int k = JunctionIndex(b, at.cell - slot * CellStore::BlockCells);
+        for (int a = b.firstArc[k]; a < b.firstArc[k + 1]; ++a) {
+            const Arc arc = b.arcs[a];
+            const int w = NodeFor(grid, arc.to);
+            if (w < 0)
+                continue;
+            const int g = at.dist + arc.length;
+            Node& n = nodes[w];
+            if (g >= n.dist)
+                continue;
+            const bool open = n.dist != INT_MAX;
+            if (open && !heap.Contains(w))
+                continue;
+            const int f = g + PathFinder::Estimate(cells.Pos(arc.to), targets, targetCount);
+            n.dist = g;
+            n.parent = v;
+            n.arc = a;
+            if (open)
+                heap.Lower(w, PathFinder::HeapKey(f, g));
+            else
+                heap.Push(w, PathFinder::HeapKey(f, g));
+        }
+    }
+
+    int nearest = -1;
+    for (int t = 0; t < targetCount; ++t)
+        if (best[t] != INT_MAX && (nearest < 0 || best[t] < best[nearest]))
+            nearest = t;
+    return nearest;
+}
+
+int PortalGraph::Distance(int t) const
+{
+    return t < targetCount && best[t] != INT_MAX ? best[t] : -1;
+}
+
+bool PortalGraph::Trace(const CellStore& cells, int t, ArraySequence<int>& path)
+{
+    path.Clear();
+    if (Distance(t) < 0)
+        return false;
+
+    const int target = targetCell[t];
+    if (bestNode[t] < 0) {
+        SearchBlock(cells, origin, target);
+        for (int c = target; c != -1; c = cellSearch.Parent(c))
+            path.Append(c);
+        for (int i = 0, j = path.GetLength() - 1; i < j; ++i, --j)
+            std::swap(path[i], path[j]);
+        return true;
+    }
+
+    // junctions back to the seed, then start..seed by cells
+    chain.Clear();
+    for (int v = bestNode[t]; v != -1; v = nodes[v].parent)
+        chain.Append(v);
+    const int seed = nodes[chain.GetLast()].cell;
+    SearchBlock(cells, origin, seed);
+    for (int c = seed; c != -1; c = cellSearch.Parent(c))
+        path.Append(c);
+    for (int i = 0, j = path.GetLength() - 1; i < j; ++i, --j)
+        std::swap(path[i], path[j]);
+
+    // arcs by their recorded steps
+    for (int i = chain.GetLength() - 2; i >= 0; --i) {
+        const Node& n = nodes[chain[i]];
+        const Node& from = nodes[n.parent];
+        const Block& b = blocks[blockOf(from.cell)];
+        const Arc& arc = b.arcs[n.arc];
+        int c = from.cell;
+        for (int s = 0; s < arc.length; ++s) {
+            c = cells.Neighbor(c, b.steps[arc.steps + s]);
+            path.Append(c);
+        }
+    }
+
+    // last junction..target: parents of a search from the target lead back
+    const int last = nodes[bestNode[t]].cell;
+    SearchBlock(cells, target, last);
+    for (int c = cellSearch.Parent(last); c != -1; c = cellSearch.Parent(c))
+        path.Append(c);
+    return true;
+}
+
+int PortalGraph::Route(HexGrid& grid, int start, const CellPos* targets, int count, ArraySequence<int>& path)
+{
+    const int t = Search(grid, start, targets, count, true);
+    if (t < 0) {
+        path.Clear();
+        return -1;
+    }
+    Trace(grid.cells, t, path);
+    return targetCell[t];
+}
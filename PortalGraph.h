@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include "ArraySequence.h"
+#include "ChunkedArray.h"
+#include "DynamicArray.h"
+#include "HexGrid.h"
+#include "IndexedHeap.h"
+#include "PathFinder.h"
+
+// Long routes planned over a contracted graph of every cell block. Inside
+// a block, dead ends that hold no portal (a cell with a corridor into
+// another block) are pruned and runs of two-way cells are contracted,
+// which leaves junctions: portals and branch cells, joined by arcs that
+// keep their corridor steps. Junctions plus the one-step crossings between
+// blocks preserve every shortest distance between portals, so a route
+// across many hexes is searched over a few dozen junctions per hex; only
+// the start and target blocks are searched cell by cell.
+//
+// A block is rebuilt lazily, when a route first reaches it after the
+// revision of its hex moved.
+class PortalGraph {
+public:
+    static constexpr int MaxTargets = 4;
+
+    // One search from start for the shortest route to each of
+    // targets[0..count), count <= MaxTargets. With nearestOnly it stops as
+    // soon as the nearest target is settled, and only that one is exact.
+    // Returns the index of the nearest reachable target, or -1.
+    int Search(HexGrid& grid, int start, const CellPos* targets, int count, bool nearestOnly);
+    // corridor steps from start to target t in the last Search, or -1
+    int Distance(int t) const;
+    // Cells from start to target t of the last Search; false and empty
+    // when it is unreachable.
+    bool Trace(const CellStore& cells, int t, ArraySequence<int>& path);
+
+    // Shortest route from start to whichever of targets[0..count) is
+    // nearest by corridor. path receives the cell ids from start to that
+    // target. Returns the target cell, or -1 with path empty.
+    int Route(HexGrid& grid, int start, const CellPos* targets, int count, ArraySequence<int>& path);
+
+    // junctions and cells expanded by the last Route
+    int Expanded() const { return expanded; }
+    // blocks rebuilt so far
+    int Rebuilt() const { return rebuilt; }
+
+private:
+    struct Arc {
+        int to = 0;      // junction cell at the far end
+        int length = 0;
+        int steps = 0;   // first direction in Block::steps
+    };
+
+    struct Block {
+        int q = 0;
+        int r = 0;
+        uint32_t revision = 0;
+        bool built = false;
+        ArraySequence<int> junctions;  // offsets in the block, ascending
+        ArraySequence<int> firstArc;   // per junction, then arcs.GetLength()
+        ArraySequence<Arc> arcs;
+        ArraySequence<uint8_t> steps;
+        // search node of each junction, valid while epoch matches
+        ArraySequence<int> node;
+        uint32_t epoch = 0;
+        // Route that last compared the revision
+        uint32_t checked = 0;
+    };
+
+    struct Node {
+        int cell = 0;
+        int dist = 0;
+        int parent = -1;     // node the best arc starts at, -1 for a seed
+        int arc = -1;        // that arc's index in the parent's block
+        // corridor distance to each target in this block, or -1
+        int toTarget[MaxTargets] = { -1, -1, -1, -1 };
+    };
+
+    Block& Ensure(HexGrid& grid, int slot);
+    void Build(const CellStore& cells, int slot, Block& b);
+    static int JunctionIndex(const Block& b, int offset);
+    int NodeFor(HexGrid& grid, int cell);
+    // breadth-first search from 'from' that stays in its block and stops
+    // at 'to' (-1: floods the block)
+    void SearchBlock(const CellStore& cells, int from, int to);
+    int Bound(bool nearestOnly) const;
+
+    ChunkedArray<Block> blocks;  // by block slot
+    PathFinder cellSearch;
+    DynamicArray<Node> nodes;
+    int nodeCount = 0;
+    IndexedHeap heap;
+    uint32_t epoch = 0;
+
+    // the last Search
+    int origin = -1;
+    int targetCount = 0;
+    int targetCell[MaxTargets] = {};
+    int best[MaxTargets] = {};
+    int bestNode[MaxTargets] = {};
+
+    int expanded = 0;
+    int rebuilt = 0;
+
+    // Build scratch, one entry per block offset
+    uint8_t live[CellStore::BlockCells];
+    uint8_t kind[CellStore::BlockCells];
+    ArraySequence<int> pending;
+    ArraySequence<int> chain;
+};